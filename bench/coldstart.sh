@@ -0,0 +1,58 @@
+#!/bin/sh
+# Start-up cost of text versus precompiled (.voltc) inputs: for each shape,
+# generates a program, writes it as .voltc, and times whole invocations of
+# bin/voltage on both (IR to /dev/null, --run, and --jit on x86-64), so the
+# run modes measure start-up to printed result. Prints one JSON line per
+# shape and mode with the best of REPEAT wall-clock times. The inputs are in
+# the page cache, so this measures process start to exit, not disk reads.
+#
+#   bench/coldstart.sh [STMTS] [SEED] [REPEAT] [SHAPES]
+set -e
+
+STMTS=${1:-200000}
+SEED=${2:-1}
+REPEAT=${3:-5}
+SHAPES=${4:-decls nested ladder mixed}
+DIR=bench/out/coldstart
+MODES="ir run"
+if [ "$(uname -m)" = x86_64 ]; then MODES="ir run jit"; fi
+
+rm -rf "$DIR"
+mkdir -p "$DIR"
+
+now_ns() { date +%s%N; }
+
+# best_ns <command>...: best wall-clock time of REPEAT runs, in ns.
+best_ns() {
+    best=
+    r=0
+    while [ "$r" -lt "$REPEAT" ]; do
+        t0=$(now_ns)
+        "$@" > /dev/null
+        t1=$(now_ns)
+        ns=$((t1 - t0))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then best=$ns; fi
+        r=$((r + 1))
+    done
+    echo "$best"
+}
+
+for s in $SHAPES; do
+    bin/voltgen --shape "$s" --stmts "$STMTS" --seed "$SEED" -o "$DIR/$s.volt"
+    bin/voltage --emit-voltc -o "$DIR/$s.voltc" "$DIR/$s.volt"
+    for mode in $MODES; do
+        case $mode in
+            run) flags=--run ;;
+            jit) flags=--jit ;;
+            *) flags="-o /dev/null" ;;
+        esac
+        # shellcheck disable=SC2086
+        text=$(best_ns bin/voltage $flags "$DIR/$s.volt")
+        # shellcheck disable=SC2086
+        voltc=$(best_ns bin/voltage $flags "$DIR/$s.voltc")
+        awk -v s="$s" -v m="$mode" -v n="$STMTS" -v t="$text" -v v="$voltc" \
+            -v tb="$(wc -c < "$DIR/$s.volt")" -v vb="$(wc -c < "$DIR/$s.voltc")" 'BEGIN {
+            printf "{\"bench\":\"coldstart\",\"shape\":\"%s\",\"mode\":\"%s\",\"stmts\":%d,\"text_bytes\":%d,\"voltc_bytes\":%d,\"text_seconds\":%.6f,\"voltc_seconds\":%.6f,\"speedup\":%.2f}\n",
+                   s, m, n, tb, vb, t / 1e9, v / 1e9, t / v }'
+    done
+done
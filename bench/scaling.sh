@@ -0,0 +1,43 @@
+#!/bin/sh
+# Thread scaling of multi-file compilation: compiles one directory of
+# generated modules with -j 1 .. -j THREADS and prints one JSON line per
+# thread count (best of REPEAT wall-clock times, speedup over -j 1).
+#
+#   bench/scaling.sh [FILES] [STMTS] [THREADS] [REPEAT]
+set -e
+
+FILES=${1:-64}
+STMTS=${2:-5000}
+THREADS=${3:-$(nproc 2>/dev/null || echo 4)}
+REPEAT=${4:-3}
+DIR=bench/out/scaling
+
+rm -rf "$DIR" "$DIR-ir"
+mkdir -p "$DIR"
+i=1
+while [ "$i" -le "$FILES" ]; do
+    bin/voltgen --shape mixed --stmts "$STMTS" --seed "$i" -o "$DIR/m$i.volt"
+    i=$((i + 1))
+done
+
+now_ns() { date +%s%N; }
+
+base=
+j=1
+while [ "$j" -le "$THREADS" ]; do
+    best=
+    r=0
+    while [ "$r" -lt "$REPEAT" ]; do
+        t0=$(now_ns)
+        bin/voltage -j "$j" -o "$DIR-ir" "$DIR"
+        t1=$(now_ns)
+        ns=$((t1 - t0))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then best=$ns; fi
+        r=$((r + 1))
+    done
+    [ -n "$base" ] || base=$best
+    awk -v j="$j" -v f="$FILES" -v s="$STMTS" -v ns="$best" -v base="$base" 'BEGIN {
+        printf "{\"bench\":\"scaling\",\"threads\":%d,\"files\":%d,\"stmts_per_file\":%d,\"seconds\":%.6f,\"speedup\":%.2f}\n",
+               j, f, s, ns / 1e9, base / ns }'
+    j=$((j + 1))
+done
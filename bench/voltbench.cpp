@@ -0,0 +1,196 @@
+// Compiler throughput benchmark.
+//
+//   voltbench [--repeat N] <file.volt>...
+//
+// Runs each front-end and back-end phase over every file N times (default 5)
+// and prints one JSON object per file on stdout, so runs can be appended to
+// a log and compared over time. Times are the best of the N runs; allocation
+// counts come from the last run. Lexing is also timed on its own, but the
+// "parse" phase always includes it because the parser pulls tokens on demand.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#include "codegen.h"
+#include "fold.h"
+#include "jit.h"
+#include "parser.h"
+#include "scan.h"
+#include "sema.h"
+#include "source.h"
+#include "stats.h"
+#include "vm.h"
+
+namespace {
+
+enum Phase { LEX, PARSE, SEMA, FOLD, CODEGEN, BYTECODE, JIT, PHASE_COUNT };
+const char* const PHASE_NAMES[] = {"lex", "parse", "sema", "fold", "codegen", "bytecode", "jit"};
+
+struct Sample {
+    double seconds = 0;
+    uint64_t allocs = 0;
+};
+
+class Timer {
+    Sample& best;
+    bool first;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t allocs = heapCount().allocs;
+public:
+    Timer(Sample& s, bool first_run) : best(s), first(first_run) {}
+    ~Timer() {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (first || t < best.seconds) best.seconds = t;
+        best.allocs = heapCount().allocs - allocs;
+    }
+};
+
+size_t peakRssKb() {
+#ifndef _WIN32
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) return static_cast<size_t>(ru.ru_maxrss);
+#endif
+    return 0;
+}
+
+// Number of statements, nested ones included.
+size_t countStatements(const Ast& ast) {
+    size_t n = 0;
+    for (const Node& node : ast.nodes)
+        if (node.kind == NodeKind::VAR_DECL || node.kind == NodeKind::IF) ++n;
+    return n;
+}
+
+std::string jsonString(const std::string& s) {
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') r += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof buf, "\\u%04x", c);
+            r += buf;
+        } else {
+            r += c;
+        }
+    }
+    return r + "\"";
+}
+
+bool benchFile(const std::string& path, int repeat, int null_fd) {
+    SourceFile source(path);
+    std::string_view text = source.text();
+    Sample samples[PHASE_COUNT];
+    size_t tokens = 0, statements = 0, nodes = 0, ir_bytes = 0, code_bytes = 0;
+    bool jit = jitSupported();
+
+    for (int r = 0; r < repeat; ++r) {
+        bool first = r == 0;
+        {
+            Timer t(samples[LEX], first);
+            tokens = Parser::countTokens(text);
+        }
+        Ast ast;
+        {
+            Timer t(samples[PARSE], first);
+            ast = Parser::parseProgram(text);
+        }
+        statements = countStatements(ast);
+        nodes = ast.nodes.size();
+        Context ctx;
+        {
+            Timer t(samples[SEMA], first);
+            Sema sema(ast, ctx);
+            if (!sema.run()) {
+                std::cerr << path << ": " << sema.diagnostics().front().message << std::endl;
+                return false;
+            }
+        }
+        {
+            Timer t(samples[FOLD], first);
+            Folder(ast).run();
+        }
+        {
+            Timer t(samples[CODEGEN], first);
+            IrWriter out(null_fd);
+            CodeGen gen(ast, ctx, out);
+            gen.emitFunction();
+            out.flush();
+            ir_bytes = out.bytesWritten();
+        }
+        {
+            Timer t(samples[BYTECODE], first);
+            compileBytecode(ast);
+        }
+        if (jit) {
+            Timer t(samples[JIT], first);
+            Bytecode bc = compileBytecode(ast, false);
+            code_bytes = JitProgram(bc).codeSize();
+        }
+    }
+
+    double mb = text.size() / 1e6;
+    std::cout << "{\"file\":" << jsonString(path) << ",\"bytes\":" << text.size() << ",\"tokens\":" << tokens
+              << ",\"statements\":" << statements << ",\"nodes\":" << nodes << ",\"ir_bytes\":" << ir_bytes
+              << ",\"jit_code_bytes\":" << code_bytes << ",\"repeat\":" << repeat
+              << ",\"scan_backend\":" << jsonString(scanBackend()) << ",\"phases\":{";
+    bool sep = false;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        if (p == JIT && !jit) continue;
+        const Sample& s = samples[p];
+        char buf[256];
+        std::snprintf(buf, sizeof buf,
+                      "%s\"%s\":{\"seconds\":%.6f,\"mb_per_s\":%.2f,\"stmts_per_s\":%.0f,\"allocs_per_stmt\":%.3f}",
+                      sep ? "," : "", PHASE_NAMES[p], s.seconds, s.seconds > 0 ? mb / s.seconds : 0.0,
+                      s.seconds > 0 ? statements / s.seconds : 0.0,
+                      statements ? static_cast<double>(s.allocs) / statements : 0.0);
+        std::cout << buf;
+        sep = true;
+    }
+    std::cout << "},\"peak_rss_kb\":" << peakRssKb() << "}" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int repeat = 5;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) repeat = std::atoi(argv[++i]);
+        else files.push_back(arg);
+    }
+    if (files.empty() || repeat < 1) {
+        std::cerr << "Usage: " << argv[0] << " [--repeat N] <file.volt>..." << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    int null_fd = ::open("NUL", O_WRONLY);
+#else
+    int null_fd = ::open("/dev/null", O_WRONLY);
+#endif
+    if (null_fd < 0) {
+        std::cerr << "Could not open the null device" << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+    for (const std::string& f : files) {
+        try {
+            ok = benchFile(f, repeat, null_fd) && ok;
+        } catch (const std::exception& ex) {
+            std::cerr << f << ": " << ex.what() << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
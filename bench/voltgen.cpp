@@ -0,0 +1,257 @@
+// Seeded generator of synthetic .volt programs for the benchmark.
+//
+//   voltgen [--shape decls|nested|ladder|mixed] [--stmts N] [--seed S]
+//           [--depth D] [--ladder L] [-o file.volt]
+//
+//   decls   flat declarations and reassignments with small expressions
+//   nested  expressions parenthesised D levels deep (default 16)
+//   ladder  if/elseif ladders of L branches (default 24), mostly on one
+//           int selector compared with eq
+//   mixed   all of the above plus nested ifs, int/float/double mixed
+//
+// N counts statements as the parser sees them: an if with all its branches
+// is one, plus the statements in its bodies.
+// The same arguments always produce the same program (the generator only
+// uses the raw mt19937 output, never the library's distributions). Every
+// program type-checks: float/double expressions only contain literals with
+// a decimal point, int expressions only int operands, and / and % only
+// divide by non-zero literals.
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum Type { INT, FLOAT, DOUBLE };
+const char* const TYPE_NAMES[] = {"int", "float", "double"};
+
+struct Var {
+    std::string name;
+    Type type;
+};
+
+class Generator {
+    std::mt19937 rng;
+    std::string out;
+    std::vector<Var> vars; // top-level variables, all declared at this point
+    size_t stmts = 0;
+    unsigned next_var = 0;
+    unsigned next_sel = 0;
+    unsigned depth;
+    unsigned ladder;
+
+    unsigned pick(unsigned n) { return rng() % n; }
+    bool chance(unsigned percent) { return pick(100) < percent; }
+
+    void indent(unsigned level) { out.append(level * 4, ' '); }
+
+    std::string literal(Type t) {
+        if (t == INT) return std::to_string(pick(1000));
+        return std::to_string(pick(100)) + "." + std::to_string(pick(100));
+    }
+
+    // A variable that may appear in an expression of type t: int values
+    // promote, so int expressions use int variables only.
+    const Var& operand(Type t) {
+        for (;;) {
+            const Var& v = vars[pick(static_cast<unsigned>(vars.size()))];
+            if (v.type <= t) return v;
+        }
+    }
+
+    std::string leaf(Type t) {
+        if (chance(40)) return literal(t);
+        return operand(t).name;
+    }
+
+    std::string binop(Type t) {
+        switch (pick(t == INT ? 5 : 4)) {
+            case 0: return " + ";
+            case 1: return " - ";
+            case 2: return " * ";
+            case 3: return " / ";
+            default: return " % ";
+        }
+    }
+
+    // Random tree of up to `levels` levels; divisors are always literals.
+    std::string expr(Type t, unsigned levels) {
+        if (levels == 0 || chance(25)) return leaf(t);
+        std::string op = binop(t);
+        std::string rhs = (op == " / " || op == " % ") ? nonZero(t) : expr(t, levels - 1);
+        std::string e = expr(t, levels - 1) + op + rhs;
+        return chance(50) ? "(" + e + ")" : e;
+    }
+
+    std::string nonZero(Type t) {
+        if (t == INT) return std::to_string(1 + pick(999));
+        return std::to_string(1 + pick(99)) + "." + std::to_string(pick(100));
+    }
+
+    // Parenthesised chain `depth` levels deep: ((((a + 1) * b) - 2) ...).
+    std::string nested(Type t) {
+        std::string e = leaf(t);
+        for (unsigned i = 0; i < depth; ++i) {
+            std::string op = binop(t);
+            if (op == " / " || op == " % ") e = "(" + e + op + nonZero(t) + ")";
+            else if (chance(50)) e = "(" + e + op + leaf(t) + ")";
+            else e = "(" + leaf(t) + op + e + ")";
+        }
+        return e;
+    }
+
+    std::string condition() {
+        const Var& v = vars[pick(static_cast<unsigned>(vars.size()))];
+        static const char* const OPS[] = {" gt ", " lt ", " gte ", " lte ", " di ", " eq "};
+        std::string c = v.name + OPS[pick(6)] + (v.type == INT ? literal(INT) : literal(FLOAT));
+        if (chance(20)) c += (chance(50) ? " && " : " || ") + condition();
+        return c;
+    }
+
+    // Declares a new top-level variable, or assigns an existing one by
+    // redeclaring it with the same type.
+    void declaration(unsigned level, std::string value, Type t, bool top) {
+        indent(level);
+        std::string name;
+        if (top && vars.size() > 8 && chance(30)) {
+            for (;;) {
+                const Var& v = vars[pick(static_cast<unsigned>(vars.size()))];
+                if (v.type == t) { name = v.name; break; }
+            }
+        } else {
+            name = "v" + std::to_string(next_var++);
+            if (top) vars.push_back({name, t});
+        }
+        out += "what " + name + ": " + TYPE_NAMES[t] + " = " + value + ";\n";
+        ++stmts;
+    }
+
+    // Assignment to an outer variable from inside a branch.
+    void assignment(unsigned level) {
+        const Var& v = vars[pick(static_cast<unsigned>(vars.size()))];
+        indent(level);
+        out += "what " + v.name + ": " + TYPE_NAMES[v.type] + " = " + expr(v.type, 2) + ";\n";
+        ++stmts;
+    }
+
+    Type randomType() { return static_cast<Type>(pick(3)); }
+
+    void declStatement() {
+        Type t = randomType();
+        declaration(0, expr(t, 3), t, true);
+    }
+
+    void nestedStatement() {
+        Type t = randomType();
+        declaration(0, nested(t), t, true);
+    }
+
+    // if/elseif ladder of `ladder` branches, either on one int selector
+    // compared for equality (switch-shaped) or on arbitrary conditions.
+    void ladderStatement() {
+        bool on_selector = chance(70);
+        std::string sel;
+        if (on_selector) {
+            sel = "s" + std::to_string(next_sel++);
+            out += "what " + sel + ": int = " + operand(INT).name + " % " + std::to_string(ladder) + ";\n";
+            ++stmts;
+        }
+        ++stmts;
+        for (unsigned i = 0; i < ladder; ++i) {
+            out += i == 0 ? "if " : "elseif ";
+            out += on_selector ? sel + " eq " + std::to_string(i) : condition();
+            out += " then;\n";
+            assignment(1);
+        }
+        out += "else;\n";
+        assignment(1);
+        out += "endif;\n";
+    }
+
+    // Nested ifs with local declarations and outer assignments.
+    void block(unsigned level, unsigned budget) {
+        indent(level);
+        out += "if " + condition() + " then;\n";
+        ++stmts;
+        for (unsigned i = 0; i < budget; ++i) {
+            if (level < 3 && chance(20)) block(level + 1, budget / 2 + 1);
+            else if (chance(50)) assignment(level + 1);
+            else { Type t = randomType(); declaration(level + 1, expr(t, 2), t, false); }
+        }
+        if (chance(50)) {
+            indent(level);
+            out += "else;\n";
+            assignment(level + 1);
+        }
+        indent(level);
+        out += "endif;\n";
+    }
+
+public:
+    Generator(uint32_t seed, unsigned d, unsigned l) : rng(seed), depth(d), ladder(l) {}
+
+    std::string generate(const std::string& shape, size_t target) {
+        for (unsigned i = 0; i < 4; ++i)
+            for (Type t : {INT, FLOAT, DOUBLE}) declaration(0, literal(t), t, true);
+        while (stmts < target) {
+            if (shape == "decls") declStatement();
+            else if (shape == "nested") nestedStatement();
+            else if (shape == "ladder") ladderStatement();
+            else {
+                unsigned k = pick(10);
+                if (k < 5) declStatement();
+                else if (k < 7) nestedStatement();
+                else if (k < 8) ladderStatement();
+                else block(0, 4);
+            }
+        }
+        return std::move(out);
+    }
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string shape = "mixed", output;
+    size_t target = 100000;
+    uint32_t seed = 1;
+    unsigned depth = 16, ladder = 24;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--shape" && has_value) shape = argv[++i];
+        else if (arg == "--stmts" && has_value) target = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && has_value) seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--depth" && has_value) depth = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--ladder" && has_value) ladder = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && has_value) output = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--shape decls|nested|ladder|mixed] [--stmts N] [--seed S]"
+                      << " [--depth D] [--ladder L] [-o file.volt]" << std::endl;
+            return 1;
+        }
+    }
+    if (shape != "decls" && shape != "nested" && shape != "ladder" && shape != "mixed") {
+        std::cerr << "Unknown shape " << shape << std::endl;
+        return 1;
+    }
+    if (ladder == 0) ladder = 1;
+
+    Generator gen(seed, depth, ladder);
+    std::string text = gen.generate(shape, target);
+    if (output.empty()) {
+        std::cout << text;
+        return 0;
+    }
+    std::ofstream f(output, std::ios::binary);
+    f << text;
+    if (!f) {
+        std::cerr << "Could not write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
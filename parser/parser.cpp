@@ -1,326 +1,606 @@
 #include "parser.h"
-#include <sstream>
+#include "scan.h"
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <string>
 #include <stdexcept>
 #include <initializer_list>
-
-// Forward declarations in caso non siano già dichiarati negli header
-class Expr;
-class Context;
-class BinOp;
-class Number;
-class Variable;
-class VarDeclaration;
-class IfStatement;
-enum class VoltType;
+#include <algorithm>
+#include <cstring>
 
 namespace {
 
-enum TokenType {
-    NUM, ID, WHAT, COLON, TYPE, ASSIGN, PLUS, MINUS, MUL, DIV, MOD,
-    AND, OR, LPAREN, RPAREN, END, SEMICOLON,
-    IF, THEN, ELSE, ELSEIF, ENDIF,
-    GT, LT, GTE, LTE, DI
+struct Token {
+    TokenType type;
+    std::string_view text;
+    uint32_t offset = 0;
+    uint32_t sym = 0; // ID: interned symbol id; TYPE: the VoltType
 };
 
-struct Token {
+// Keywords are recognised with a perfect hash of the length and the first
+// and last byte: one table probe and one comparison per identifier. The
+// table is built, and checked for collisions, at compile time.
+struct Keyword {
+    std::string_view word;
     TokenType type;
-    std::string text;
+    VoltType vtype; // for TYPE
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"what", WHAT, VoltType::INT}, {"int", TYPE, VoltType::INT}, {"float", TYPE, VoltType::FLOAT},
+    {"double", TYPE, VoltType::DOUBLE}, {"if", IF, VoltType::INT}, {"then", THEN, VoltType::INT},
+    {"else", ELSE, VoltType::INT}, {"elseif", ELSEIF, VoltType::INT}, {"endif", ENDIF, VoltType::INT},
+    {"gt", GT, VoltType::INT}, {"lt", LT, VoltType::INT}, {"gte", GTE, VoltType::INT},
+    {"lte", LTE, VoltType::INT}, {"di", DI, VoltType::INT}, {"eq", EQ, VoltType::INT},
+    {"for", FOR, VoltType::INT}, {"from", FROM, VoltType::INT}, {"until", UNTIL, VoltType::INT},
+    {"do", DO, VoltType::INT}, {"endfor", ENDFOR, VoltType::INT},
+    {"i8", TYPE, VoltType::I8}, {"i16", TYPE, VoltType::I16}, {"i64", TYPE, VoltType::I64},
+    {"u8", TYPE, VoltType::U8}, {"u16", TYPE, VoltType::U16}, {"u32", TYPE, VoltType::U32},
+    {"u64", TYPE, VoltType::U64},
+};
+constexpr size_t KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+constexpr size_t KEYWORD_SLOTS = 128;
+constexpr size_t KEYWORD_MIN_LEN = 2, KEYWORD_MAX_LEN = 6;
+
+constexpr size_t keywordHash(std::string_view w) {
+    return (w.size() + 5 * (static_cast<unsigned char>(w.front()) + static_cast<unsigned char>(w.back()))) &
+           (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable {
+    int8_t slot[KEYWORD_SLOTS];
+    bool perfect;
 };
 
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable t{};
+    for (size_t i = 0; i < KEYWORD_SLOTS; ++i) t.slot[i] = -1;
+    t.perfect = true;
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        size_t h = keywordHash(KEYWORDS[i].word);
+        if (t.slot[h] != -1) t.perfect = false;
+        t.slot[h] = static_cast<int8_t>(i);
+    }
+    return t;
+}
+
+constexpr KeywordTable KEYWORD_TABLE = buildKeywordTable();
+static_assert(KEYWORD_TABLE.perfect, "keyword hash has collisions");
+
+// Index into KEYWORDS, or -1 if the word is an identifier.
+int keywordIndex(std::string_view w) {
+    if (w.size() < KEYWORD_MIN_LEN || w.size() > KEYWORD_MAX_LEN) return -1;
+    int k = KEYWORD_TABLE.slot[keywordHash(w)];
+    return k >= 0 && KEYWORDS[k].word == w ? k : -1;
+}
+
+// Scans the whole source in place; token texts are views into it.
+// Identifiers are interned as they are scanned, so later passes only see
+// dense symbol ids.
 class Lexer {
-    std::string text;
+    std::string_view text;
+    StringPool& symbols;
     size_t pos = 0;
-    std::istringstream in;
-    char curr;
-    void next_char() { curr = in.get(); }
+    uint32_t start = 0;
+    Token tok(TokenType t, std::string_view s, uint32_t sym = 0) const { return {t, s, start, sym}; }
 public:
-    explicit Lexer(const std::string& s) : text(s), pos(0), in(s), curr(0) { next_char(); }
+    Lexer(std::string_view s, StringPool& pool) : text(s), symbols(pool) {}
+    uint32_t offset() const { return static_cast<uint32_t>(pos); }
     Token next() {
-        while (pos < text.size() && std::isspace(text[pos])) ++pos;
-        if (pos >= text.size()) return {END, ""};
-
-        if (text[pos] == ';') { ++pos; return {SEMICOLON, ";"}; }
-        if (std::isdigit(text[pos]) || (text[pos] == '.' && pos + 1 < text.size() && std::isdigit(text[pos + 1]))) {
-            size_t start = pos;
-            bool has_dot = false;
-            while (pos < text.size() && (std::isdigit(text[pos]) || text[pos] == '.')) {
-                if (text[pos] == '.') {
-                    if (has_dot) break;
-                    has_dot = true;
-                }
-                ++pos;
-            }
-            return {NUM, text.substr(start, pos - start)};
+        pos = skipSpace(text, pos);
+        start = static_cast<uint32_t>(pos);
+        if (pos >= text.size()) return tok(END, "");
+
+        if (text[pos] == ';') { ++pos; return tok(SEMICOLON, ";"); }
+        if (isDigit(text[pos]) || (text[pos] == '.' && pos + 1 < text.size() && isDigit(text[pos + 1]))) {
+            pos = scanDigits(text, pos);
+            if (pos < text.size() && text[pos] == '.') pos = scanDigits(text, pos + 1);
+            return tok(NUM, text.substr(start, pos - start));
         }
-        if (std::isalpha(text[pos]) || text[pos] == '_') {
-            size_t start = pos;
-            while (pos < text.size() && (std::isalnum(text[pos]) || text[pos] == '_')) ++pos;
-            std::string word = text.substr(start, pos - start);
-            if (word == "what") return {WHAT, ""};
-            if (word == "int" || word == "float" || word == "double") return {TYPE, word};
-            if (word == "if") return {IF, ""};
-            if (word == "then") return {THEN, ""};
-            if (word == "else") return {ELSE, ""};
-            if (word == "elseif") return {ELSEIF, ""};
-            if (word == "endif") return {ENDIF, ""};
-            if (word == "gt") return {GT, "gt"};
-            if (word == "lt") return {LT, "lt"};
-            if (word == "gte") return {GTE, "gte"};
-            if (word == "lte") return {LTE, "lte"};
-            if (word == "di") return {DI, "di"};
-            return {ID, word};
+        if (isIdentStart(text[pos])) {
+            pos = scanIdent(text, pos + 1);
+            std::string_view word = text.substr(start, pos - start);
+            int k = keywordIndex(word);
+            if (k >= 0) return tok(KEYWORDS[k].type, word, static_cast<uint32_t>(KEYWORDS[k].vtype));
+            return tok(ID, word, symbols.intern(word));
         }
-        if (text[pos] == ':') { ++pos; return {COLON, ":"}; }
+        if (text[pos] == ':') { ++pos; return tok(COLON, ":"); }
         if (text[pos] == '=') {
             if (pos+1 < text.size() && text[pos+1] == '=') {
                 pos += 2;
-                return {DI, "=="};
+                return tok(EQ, "==");
             }
-            ++pos; return {ASSIGN, "="};
+            ++pos; return tok(ASSIGN, "=");
         }
-        if (text[pos] == '+') { ++pos; return {PLUS, "+"}; }
-        if (text[pos] == '-') { ++pos; return {MINUS, "-"}; }
-        if (text[pos] == '*') { ++pos; return {MUL, "*"}; }
-        if (text[pos] == '/') { ++pos; return {DIV, "/"}; }
-        if (text[pos] == '%') { ++pos; return {MOD, "%"}; }
-        if (text.substr(pos,2) == "&&") { pos += 2; return {AND, "&&"}; }
-        if (text.substr(pos,2) == "||") { pos += 2; return {OR, "||"}; }
-        if (text[pos] == '(') { ++pos; return {LPAREN, "("}; }
-        if (text[pos] == ')') { ++pos; return {RPAREN, ")"}; }
+        if (text[pos] == '+') { ++pos; return tok(PLUS, "+"); }
+        if (text[pos] == '-') { ++pos; return tok(MINUS, "-"); }
+        if (text[pos] == '*') { ++pos; return tok(MUL, "*"); }
+        if (text[pos] == '/') { ++pos; return tok(DIV, "/"); }
+        if (text[pos] == '%') { ++pos; return tok(MOD, "%"); }
+        if (text.substr(pos,2) == "&&") { pos += 2; return tok(AND, "&&"); }
+        if (text.substr(pos,2) == "||") { pos += 2; return tok(OR, "||"); }
+        if (text[pos] == '(') { ++pos; return tok(LPAREN, "("); }
+        if (text[pos] == ')') { ++pos; return tok(RPAREN, ")"); }
+        if (text[pos] == '[') { ++pos; return tok(LBRACKET, "["); }
+        if (text[pos] == ']') { ++pos; return tok(RBRACKET, "]"); }
+        if (text[pos] == ',') { ++pos; return tok(COMMA, ","); }
         if (text[pos] == '>') {
-            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return {GTE, ">="}; }
-            ++pos; return {GT, ">"};
+            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return tok(GTE, ">="); }
+            ++pos; return tok(GT, ">");
         }
         if (text[pos] == '<') {
-            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return {LTE, "<="}; }
-            ++pos; return {LT, "<"};
+            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return tok(LTE, "<="); }
+            ++pos; return tok(LT, "<");
         }
         if (text[pos] == '!') {
-            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return {DI, "!="}; }
+            if (pos+1 < text.size() && text[pos+1] == '=') { pos+=2; return tok(DI, "!="); }
         }
-        throw std::runtime_error(std::string("Invalid character '") + text[pos] + "'");
+        throw ParseError(std::string("Invalid character '") + text[pos] + "'", start);
     }
 };
 
-// Logic operator AST node
-struct LogicOp : Expr {
-    TokenType op;
-    std::unique_ptr<Expr> left, right;
-    LogicOp(TokenType op, std::unique_ptr<Expr> l, std::unique_ptr<Expr> r)
-        : op(op), left(std::move(l)), right(std::move(r)) {}
-    VoltType getType(Context&) const override { return VoltType::INT; }
-    std::string toLLVMIR(Context&, std::string&) const override {
-        return "; logic op not yet implemented in IR";
+// Binding strength of each token after an operand. Binary operators are
+// 2 (comparisons) to 6 (* / %), all left-associative; any other token ends
+// the operand's expression or parenthesis and is 1.
+constexpr uint8_t ENDS_OPERAND = 1, BINDS_ALWAYS = UINT8_MAX;
+
+struct OperatorTable {
+    uint8_t precedence[SHL + 1];
+    NodeKind kind[SHL + 1];
+};
+
+constexpr OperatorTable buildOperatorTable() {
+    OperatorTable t{};
+    for (uint8_t& p : t.precedence) p = ENDS_OPERAND;
+    for (NodeKind& k : t.kind) k = NodeKind::BINOP;
+    for (TokenType op : {GT, LT, GTE, LTE, DI, EQ}) {
+        t.precedence[op] = 2;
+        t.kind[op] = NodeKind::LOGICOP;
     }
+    t.precedence[OR] = 3;
+    t.precedence[AND] = 4;
+    t.precedence[PLUS] = t.precedence[MINUS] = 5;
+    t.precedence[MUL] = t.precedence[DIV] = t.precedence[MOD] = 6;
+    return t;
+}
+
+constexpr OperatorTable OPERATORS = buildOperatorTable();
+
+// An operator waiting for its right operand while an expression is parsed.
+// It is applied once the token after that operand binds no tighter than
+// `precedence`: a unary minus and a variable's comparison bind tighter
+// than anything, and an open bracket (or the start of the expression)
+// that stops the search never applies. Brackets are '(' (op LPAREN), an
+// array literal (op LBRACKET, kind ARRAY) and an index (kind INDEX).
+struct Pending {
+    uint8_t precedence;
+    uint8_t op;
+    NodeKind kind;
+    VoltType context; // brackets: the literal type outside them
+    uint32_t left;    // left operand, the zero a unary minus subtracts from,
+                      // an indexed variable or where a literal's elements start
 };
 
 class ParserImpl {
+    Ast ast;
     Lexer lex;
     Token curr;
     VoltType default_type = VoltType::INT;
-    void next() { curr = lex.next(); }
+    uint32_t prev_end = 0; // end of the previous token, where a missing ';' belongs
+    std::vector<uint32_t> scratch; // statement lists of the blocks being parsed
+    std::vector<Pending> pending;  // operators of the expressions being parsed
+    void next() { prev_end = lex.offset(); curr = lex.next(); }
+    ParseError error(const std::string& msg) const { return ParseError(msg, curr.offset); }
+    ParseError missing_semicolon(const std::string& msg) const { return ParseError(msg, prev_end); }
+    uint32_t node(NodeKind kind, uint8_t op, VoltType type, uint32_t a, uint32_t b) {
+        return ast.add(Node{kind, op, type, 0, a, b});
+    }
+    uint32_t binop(NodeKind kind, TokenType op, uint32_t l, uint32_t r) {
+        return node(kind, static_cast<uint8_t>(op), VoltType::INT, l, r);
+    }
+    uint32_t number(std::string_view text, VoltType type) {
+        return node(NodeKind::NUMBER, 0, type, ast.strings.intern(text), 0);
+    }
 public:
-    explicit ParserImpl(const std::string& s) : lex(s) { next(); }
-    std::unique_ptr<Expr> parse() {
-        auto node = statement();
-        if (curr.type != SEMICOLON)
-            throw std::runtime_error("Expected ';' at end of statement");
+    explicit ParserImpl(std::string_view s) : lex(s, ast.strings) {
+        // Roughly one node per 4 bytes of source keeps reallocation rare.
+        ast.nodes.reserve(s.size() / 4 + 16);
         next();
-        if (curr.type != END)
-            throw std::runtime_error("Unexpected input after ';'");
-        return node;
+    }
+    Ast parse() {
+        while (curr.type != END) {
+            if (curr.type == SEMICOLON) {
+                next();
+                continue;
+            }
+            uint32_t offset = curr.offset;
+            uint32_t n = statement();
+            if (curr.type != SEMICOLON)
+                throw missing_semicolon("Expected ';' at end of statement");
+            next();
+            ast.roots.push_back(n);
+            ast.offsets.push_back(offset);
+        }
+        return std::move(ast);
     }
 private:
-    std::unique_ptr<Expr> statement() {
+    uint32_t statement() {
         if (curr.type == IF) return if_statement();
+        if (curr.type == FOR) return for_statement();
         if (curr.type == WHAT) {
             next();
-            if (curr.type != ID) throw std::runtime_error("Expected variable name");
-            std::string var = curr.text;
+            if (curr.type != ID) throw error("Expected variable name");
+            uint32_t var = curr.sym;
             next();
-            if (curr.type != COLON) throw std::runtime_error("Expected ':' after variable name");
+            if (curr.type != COLON) throw error("Expected ':' after variable name");
             next();
-            VoltType vtype = VoltType::INT;
-            if (curr.type == TYPE) {
-                if (curr.text == "int") vtype = VoltType::INT;
-                else if (curr.text == "float") vtype = VoltType::FLOAT;
-                else if (curr.text == "double") vtype = VoltType::DOUBLE;
-                else throw std::runtime_error("Unknown type: " + curr.text);
-            } else throw std::runtime_error("Expected type after ':'");
+            if (curr.type != TYPE) throw error("Expected type after ':'");
+            VoltType vtype = static_cast<VoltType>(curr.sym);
             next();
-            if (curr.type != ASSIGN) throw std::runtime_error("Expected '=' after type");
+            uint8_t length = 0;
+            if (curr.type == LBRACKET) {
+                next();
+                uint32_t n = 0; // stays 0 unless the length is a whole number of up to 3 digits
+                if (curr.type == NUM && curr.text.size() <= 3 && curr.text.find('.') == std::string_view::npos)
+                    for (char c : curr.text) n = n * 10 + static_cast<uint32_t>(c - '0');
+                if (n == 0 || n > MAX_ARRAY_LENGTH)
+                    throw error("Array length must be a whole number from 1 to " + std::to_string(MAX_ARRAY_LENGTH));
+                length = static_cast<uint8_t>(n);
+                next();
+                if (curr.type != RBRACKET) throw error("Expected ']' after array length");
+                next();
+            }
+            if (curr.type != ASSIGN) throw error("Expected '=' after type");
             next();
-            auto value = expr(vtype);
-            return std::make_unique<VarDeclaration>(var, vtype, std::move(value));
+            uint32_t value = expr(vtype);
+            return ast.add(Node{NodeKind::VAR_DECL, 0, vtype, length, var, value});
         }
         return expr(default_type);
     }
 
-    std::unique_ptr<Expr> if_statement() {
+    uint32_t for_statement() {
+        next();
+        if (curr.type != ID) throw error("Expected loop variable after 'for'");
+        uint32_t var = curr.sym;
+        next();
+        if (curr.type != FROM) throw error("Expected 'from' after loop variable");
+        next();
+        uint32_t from = expr(VoltType::INT);
+        if (curr.type != UNTIL) throw error("Expected 'until' after loop start");
+        next();
+        uint32_t until = expr(VoltType::INT);
+        if (curr.type != DO) throw error("Expected 'do' after loop end");
+        next();
+        if (curr.type != SEMICOLON) throw error("Expected ';' after do");
+        next();
+        IfBranch body = parse_block_until(NO_NODE, {ENDFOR});
+        next();
+        // The closing ';' is consumed by the caller like any other statement.
+        if (curr.type != SEMICOLON) throw error("Expected ';' after endfor");
+
+        uint32_t list = static_cast<uint32_t>(ast.extra.size());
+        ast.extra.insert(ast.extra.end(), scratch.begin() + body.first, scratch.end());
+        scratch.resize(body.first);
+        uint32_t record = static_cast<uint32_t>(ast.extra.size());
+        ast.extra.insert(ast.extra.end(), {var, from, until, list, body.count});
+        return node(NodeKind::FOR, 0, VoltType::INT, record, 0);
+    }
+
+    uint32_t if_statement() {
+        // Conditions and statement lists are collected first and copied into
+        // Ast::extra once the whole if is known, so nested ifs stay contiguous.
+        std::vector<IfBranch> branches;
         next();
-        auto if_cond = expr(VoltType::INT);
-        if (curr.type != THEN) throw std::runtime_error("Expected 'then' after if condition");
+        uint32_t if_cond = expr(VoltType::INT);
+        if (curr.type != THEN) throw error("Expected 'then' after if condition");
         next();
-        if (curr.type != SEMICOLON) throw std::runtime_error("Expected ';' after then");
+        if (curr.type != SEMICOLON) throw error("Expected ';' after then");
         next();
-        auto if_branch = parse_block_until({ELSEIF, ELSE, ENDIF});
-        std::vector<std::unique_ptr<Expr>> stmts = std::move(if_branch);
-        IfStatement::Branch main_branch{std::move(if_cond), std::move(stmts)};
-        std::vector<IfStatement::Branch> branches;
-        branches.push_back(std::move(main_branch));
+        branches.push_back(parse_block_until(if_cond, {ELSEIF, ELSE, ENDIF}));
         while (curr.type == ELSEIF) {
             next();
-            auto elseif_cond = expr(VoltType::INT);
-            if (curr.type != THEN) throw std::runtime_error("Expected 'then' after elseif condition");
+            uint32_t elseif_cond = expr(VoltType::INT);
+            if (curr.type != THEN) throw error("Expected 'then' after elseif condition");
             next();
-            if (curr.type != SEMICOLON) throw std::runtime_error("Expected ';' after then");
+            if (curr.type != SEMICOLON) throw error("Expected ';' after then");
             next();
-            auto elseif_stmts = parse_block_until({ELSEIF, ELSE, ENDIF});
-            branches.emplace_back(IfStatement::Branch{std::move(elseif_cond), std::move(elseif_stmts)});
+            branches.push_back(parse_block_until(elseif_cond, {ELSEIF, ELSE, ENDIF}));
         }
         if (curr.type == ELSE) {
             next();
-            if (curr.type != SEMICOLON) throw std::runtime_error("Expected ';' after else");
+            if (curr.type != SEMICOLON) throw error("Expected ';' after else");
             next();
-            auto else_stmts = parse_block_until({ENDIF});
-            branches.emplace_back(IfStatement::Branch{nullptr, std::move(else_stmts)});
+            branches.push_back(parse_block_until(NO_NODE, {ENDIF}));
         }
-        if (curr.type != ENDIF) throw std::runtime_error("Expected 'endif' to close if statement");
-        next();
-        if (curr.type != SEMICOLON) throw std::runtime_error("Expected ';' after endif");
+        if (curr.type != ENDIF) throw error("Expected 'endif' to close if statement");
         next();
-        auto ifs = std::make_unique<IfStatement>();
-        ifs->branches = std::move(branches);
-        return ifs;
+        // The closing ';' is consumed by the caller like any other statement.
+        if (curr.type != SEMICOLON) throw error("Expected ';' after endif");
+
+        // Statement lists were pushed on the scratch stack in branch order.
+        uint32_t base = static_cast<uint32_t>(scratch.size());
+        for (const IfBranch& br : branches) base -= br.count;
+        uint32_t lists = static_cast<uint32_t>(ast.extra.size());
+        ast.extra.insert(ast.extra.end(), scratch.begin() + base, scratch.end());
+        scratch.resize(base);
+        uint32_t records = static_cast<uint32_t>(ast.extra.size());
+        for (const IfBranch& br : branches) {
+            ast.extra.push_back(br.cond);
+            ast.extra.push_back(lists + (br.first - base));
+            ast.extra.push_back(br.count);
+        }
+        return node(NodeKind::IF, 0, VoltType::INT, records, static_cast<uint32_t>(branches.size()));
     }
 
-    std::vector<std::unique_ptr<Expr>> parse_block_until(std::initializer_list<TokenType> stopTokens) {
-        std::vector<std::unique_ptr<Expr>> statements;
+    // Parses statements up to one of stopTokens and pushes them on the scratch
+    // stack; the returned branch's `first` is a scratch index.
+    IfBranch parse_block_until(uint32_t cond, std::initializer_list<TokenType> stopTokens) {
+        std::vector<uint32_t> statements;
         while (true) {
-            for (auto t : stopTokens) if (curr.type == t) return statements;
+            bool stop = false;
+            for (auto t : stopTokens) if (curr.type == t) stop = true;
+            if (stop) break;
+            if (curr.type == END)
+                throw error(stopTokens.end()[-1] == ENDFOR ? "Expected 'endfor' to close for loop"
+                                                           : "Expected 'endif' to close if statement");
             if (curr.type == SEMICOLON) {
                 next();
                 continue;
             }
-            auto stmt = statement();
-            if (curr.type != SEMICOLON) throw std::runtime_error("Expected ';' at end of statement in block");
+            uint32_t stmt = statement();
+            if (curr.type != SEMICOLON) throw missing_semicolon("Expected ';' at end of statement in block");
             next();
-            statements.push_back(std::move(stmt));
+            statements.push_back(stmt);
         }
+        uint32_t first = static_cast<uint32_t>(scratch.size());
+        scratch.insert(scratch.end(), statements.begin(), statements.end());
+        return IfBranch{cond, first, static_cast<uint32_t>(statements.size())};
     }
 
-    std::unique_ptr<Expr> expr(VoltType vtype) { return logic_expr(vtype); }
-    std::unique_ptr<Expr> logic_expr(VoltType vtype) {
-        auto node = or_expr(vtype);
-        while (is_logic_op(curr.type)) {
-            TokenType op = curr.type;
-            next();
-            node = std::make_unique<LogicOp>(op, std::move(node), or_expr(vtype));
+    // Precedence climbing over an explicit stack of pending operators, so
+    // an operand costs no calls and nesting depth is bounded only by memory.
+    // An operand is a number, a variable, a parenthesised expression or a
+    // unary minus applied to one, an array literal or an indexed variable.
+    // A variable directly followed by a comparison takes the next primary
+    // (not a unary minus) as its right side before any other operator
+    // applies: `c * b > 2` is `c * (b > 2)`, while `(c * b) > 2`,
+    // `c * 2 > 2` and `c * b[0] > 2` compare the product.
+    uint32_t expr(VoltType vtype) {
+        size_t base = pending.size();
+        pending.push_back({0, END, NodeKind::BINOP, vtype, 0});
+        bool primary_only = false; // right side of a variable comparison
+        uint32_t value;
+        while (true) {
+            // Prefixes of the next operand.
+            if (curr.type == MINUS && !primary_only) {
+                next();
+                uint32_t zero = isFloatType(vtype) ? number("0.0", vtype) : number("0", VoltType::INT);
+                pending.push_back({BINDS_ALWAYS, MINUS, NodeKind::BINOP, vtype, zero});
+                continue;
+            }
+            if (curr.type == LPAREN || curr.type == LBRACKET) {
+                NodeKind kind = curr.type == LPAREN ? NodeKind::BINOP : NodeKind::ARRAY;
+                pending.push_back(
+                    {0, static_cast<uint8_t>(curr.type), kind, vtype, static_cast<uint32_t>(scratch.size())});
+                next();
+                primary_only = false;
+                continue;
+            }
+            if (curr.type == ID) {
+                uint32_t var = node(NodeKind::VARIABLE, 0, VoltType::INT, curr.sym, 0);
+                next();
+                if (curr.type == LBRACKET) { // the index is an int expression
+                    pending.push_back({0, LBRACKET, NodeKind::INDEX, vtype, var});
+                    vtype = VoltType::INT;
+                    next();
+                    primary_only = false;
+                    continue;
+                }
+                if (is_logic_op(curr.type)) {
+                    pending.push_back({BINDS_ALWAYS, static_cast<uint8_t>(curr.type), NodeKind::LOGICOP, vtype, var});
+                    next();
+                    primary_only = true;
+                    continue;
+                }
+                value = var;
+            } else if (curr.type == NUM) {
+                value = literal(vtype);
+            } else {
+                throw error("Expected number, variable or '('");
+            }
+            primary_only = false;
+
+            // Applies the pending operators that bind at least as tightly as
+            // the next token, then continues with that operator's right
+            // operand (or the next array element), closes a bracket or ends
+            // the expression.
+            while (true) {
+                uint8_t prec = OPERATORS.precedence[curr.type];
+                while (pending.back().precedence >= prec) {
+                    const Pending& p = pending.back();
+                    value = binop(p.kind, TokenType(p.op), p.left, value);
+                    pending.pop_back();
+                }
+                if (prec > ENDS_OPERAND) {
+                    pending.push_back(
+                        {prec, static_cast<uint8_t>(curr.type), OPERATORS.kind[curr.type], vtype, value});
+                    next();
+                    break;
+                }
+                if (pending.size() == base + 1) {
+                    pending.pop_back();
+                    return value;
+                }
+                Pending open = pending.back();
+                if (open.op == LPAREN) {
+                    if (curr.type != RPAREN) throw error("Expected ')'");
+                } else if (open.kind == NodeKind::INDEX) {
+                    if (curr.type != RBRACKET) throw error("Expected ']'");
+                    value = node(NodeKind::INDEX, 0, VoltType::INT, open.left, value);
+                } else {
+                    if (curr.type != COMMA && curr.type != RBRACKET) throw error("Expected ',' or ']'");
+                    scratch.push_back(value);
+                    if (curr.type == COMMA) {
+                        next();
+                        break;
+                    }
+                    value = array(open.left);
+                }
+                next();
+                vtype = open.context;
+                pending.pop_back();
+            }
         }
-        return node;
+    }
+    // Moves the elements of a literal from the scratch stack into Ast::extra.
+    uint32_t array(uint32_t first) {
+        uint32_t start = static_cast<uint32_t>(ast.extra.size());
+        ast.extra.insert(ast.extra.end(), scratch.begin() + first, scratch.end());
+        scratch.resize(first);
+        return node(NodeKind::ARRAY, 0, VoltType::INT, start, static_cast<uint32_t>(ast.extra.size()) - start);
     }
     bool is_logic_op(TokenType t) {
-        return t == GT || t == LT || t == GTE || t == LTE || t == DI;
+        return t == GT || t == LT || t == GTE || t == LTE || t == DI || t == EQ;
     }
-    std::unique_ptr<Expr> or_expr(VoltType vtype) {
-        auto node = and_expr(vtype);
-        while (curr.type == OR) {
-            next();
-            node = std::make_unique<BinOp>(12, std::move(node), and_expr(vtype));
+    uint32_t literal(VoltType vtype) {
+        std::string_view numtxt = curr.text;
+        bool has_dot = numtxt.find('.') != std::string_view::npos;
+        if (isFloatType(vtype) && !has_dot) {
+            throw error("Errore: il valore assegnato a una variabile float/double deve contenere la virgola (es: 3.0)");
         }
-        return node;
-    }
-    std::unique_ptr<Expr> and_expr(VoltType vtype) {
-        auto node = add_expr(vtype);
-        while (curr.type == AND) {
-            next();
-            node = std::make_unique<BinOp>(11, std::move(node), add_expr(vtype));
+        VoltType numtype = vtype;
+        if (has_dot) {
+            if (vtype == VoltType::DOUBLE) numtype = VoltType::DOUBLE;
+            else if (vtype == VoltType::FLOAT) numtype = VoltType::FLOAT;
+            else numtype = VoltType::FLOAT;
+        } else {
+            numtype = VoltType::INT; // Sema gives it the type of what it meets
         }
-        return node;
+        next();
+        return number(numtxt, numtype);
     }
-    std::unique_ptr<Expr> add_expr(VoltType vtype) {
-        auto node = mul_expr(vtype);
-        while (curr.type == PLUS || curr.type == MINUS) {
-            int op = curr.type;
-            next();
-            node = std::make_unique<BinOp>(op, std::move(node), mul_expr(vtype));
-        }
-        return node;
+}; // end ParserImpl
+
+} // end anonymous namespace
+
+void StringPool::grow() {
+    size_t size = slots.empty() ? 64 : slots.size() * 2;
+    while ((strings.size() + 1) * 2 > size) size *= 2;
+    slots.assign(size, 0);
+    size_t mask = size - 1;
+    for (uint32_t id = 0; id < strings.size(); ++id) {
+        size_t h = std::hash<std::string_view>()(strings[id]) & mask;
+        while (slots[h]) h = (h + 1) & mask;
+        slots[h] = id + 1;
     }
-    std::unique_ptr<Expr> mul_expr(VoltType vtype) {
-        auto node = unary_expr(vtype);
-        while (curr.type == MUL || curr.type == DIV || curr.type == MOD) {
-            int op = curr.type;
-            next();
-            node = std::make_unique<BinOp>(op, std::move(node), unary_expr(vtype));
-        }
-        return node;
+}
+
+void StringPool::assign(std::vector<std::string_view> distinct) {
+    strings = std::move(distinct);
+    slots.clear();
+}
+
+uint32_t StringPool::intern(std::string_view s) {
+    if ((strings.size() + 1) * 2 > slots.size()) grow();
+    size_t mask = slots.size() - 1;
+    size_t h = std::hash<std::string_view>()(s) & mask;
+    while (slots[h]) {
+        if (strings[slots[h] - 1] == s) return slots[h] - 1;
+        h = (h + 1) & mask;
     }
-    std::unique_ptr<Expr> unary_expr(VoltType vtype) {
-        if (curr.type == MINUS) {
-            next();
-            if (vtype == VoltType::FLOAT || vtype == VoltType::DOUBLE) {
-                return std::make_unique<BinOp>(
-                    7,
-                    std::make_unique<Number>("0.0", vtype),
-                    unary_expr(vtype)
-                );
-            } else {
-                return std::make_unique<BinOp>(
-                    7,
-                    std::make_unique<Number>("0", vtype),
-                    unary_expr(vtype)
-                );
-            }
+    strings.push_back(s);
+    slots[h] = static_cast<uint32_t>(strings.size());
+    return slots[h] - 1;
+}
+
+// Implementazione di Parser::parseProgram fuori dal namespace anonimo
+Ast Parser::parseProgram(std::string_view source) {
+    return ParserImpl(source).parse();
+}
+
+size_t Parser::countTokens(std::string_view source) {
+    StringPool pool;
+    Lexer lex(source, pool);
+    size_t n = 0;
+    while (lex.next().type != END) ++n;
+    return n;
+}
+
+std::vector<size_t> Parser::splitPoints(std::string_view source, size_t target) {
+    std::vector<size_t> cuts;
+    if (target == 0) return cuts;
+    size_t depth = 0, next_cut = target, pos = 0;
+    while (pos < source.size()) {
+        pos = skipSpace(source, pos);
+        if (pos < source.size() && isIdentStart(source[pos])) {
+            size_t end = scanIdent(source, pos + 1);
+            std::string_view word = source.substr(pos, end - pos);
+            if (word == "if" || word == "for") ++depth;
+            else if ((word == "endif" || word == "endfor") && depth > 0) --depth;
+            pos = end;
+        }
+        pos = findTerminator(source, pos);
+        if (pos < source.size()) ++pos;
+        if (depth == 0 && pos >= next_cut && pos < source.size()) {
+            cuts.push_back(pos);
+            next_cut = pos + target;
         }
-        return primary(vtype);
     }
-    std::unique_ptr<Expr> primary(VoltType vtype) {
-        if (curr.type == NUM) {
-            std::string numtxt = curr.text;
-            if ((vtype == VoltType::FLOAT || vtype == VoltType::DOUBLE) && numtxt.find('.') == std::string::npos) {
-                throw std::runtime_error("Errore: il valore assegnato a una variabile float/double deve contenere la virgola (es: 3.0)");
-            }
-            VoltType numtype = vtype;
-            if (numtxt.find('.') != std::string::npos) {
-                if (vtype == VoltType::DOUBLE) numtype = VoltType::DOUBLE;
-                else if (vtype == VoltType::FLOAT) numtype = VoltType::FLOAT;
-                else numtype = VoltType::FLOAT;
-            } else {
-                numtype = VoltType::INT;
+    return cuts;
+}
+
+StatementScan Parser::scanStatements(std::string_view source) {
+    StatementScan scan;
+    Lexer lex(source, scan.names);
+    StatementInfo st{0, 0, 0, NO_NODE, VoltType::INT, 0, 0, 0};
+    size_t tokens = 0, depth = 0;
+    TokenType prev[3] = {END, END, END}; // last tokens of the statement, newest first
+    // Multiply-xorshift over the token type and the text, 8 bytes at a time.
+    auto mix = [&](uint64_t v) {
+        st.hash = (st.hash ^ v) * 0x9e3779b97f4a7c15ull;
+        st.hash ^= st.hash >> 29;
+    };
+    for (Token t = lex.next();; t = lex.next()) {
+        if (t.type == END || (t.type == SEMICOLON && depth == 0)) {
+            if (tokens > 0) {
+                st.end = t.type == END ? static_cast<uint32_t>(source.size()) : t.offset + 1;
+                st.refs = static_cast<uint32_t>(scan.refs.size()) - st.first_ref;
+                scan.statements.push_back(st);
             }
-            next();
-            return std::make_unique<Number>(numtxt, numtype);
+            if (t.type == END) break;
+            st = {0, 0, 0, NO_NODE, VoltType::INT, 0, static_cast<uint32_t>(scan.refs.size()), 0};
+            tokens = 0;
+            continue;
         }
-        if (curr.type == ID) {
-            std::string name = curr.text;
-            next();
-            if (is_logic_op(curr.type)) {
-                auto left = std::make_unique<Variable>(name);
-                TokenType op = curr.type;
-                next();
-                auto right = primary(vtype);
-                return std::make_unique<LogicOp>(op, std::move(left), std::move(right));
-            }
-            return std::make_unique<Variable>(name);
+        if (tokens++ == 0) {
+            st.begin = t.offset;
+            st.hash = 0;
         }
-        if (curr.type == LPAREN) {
-            next();
-            auto node = expr(vtype);
-            if (curr.type != RPAREN) throw std::runtime_error("Expected ')'");
-            next();
-            return node;
+        if ((t.type == IF || t.type == FOR) && (tokens == 1 || prev[0] == SEMICOLON)) ++depth;
+        else if ((t.type == ENDIF || t.type == ENDFOR) && depth > 0) --depth;
+        else if (t.type == ID) scan.refs.push_back(t.sym);
+        // what NAME : TYPE
+        if (tokens == 4 && prev[2] == WHAT && prev[1] == ID && prev[0] == COLON && t.type == TYPE) {
+            st.decl = scan.refs.back();
+            st.decl_type = static_cast<VoltType>(t.sym);
         }
-        throw std::runtime_error("Expected number, variable or '('");
+        // ... TYPE [ NUM ]; a malformed length fails to parse later anyway
+        if (tokens == 6 && st.decl != NO_NODE && prev[0] == LBRACKET && t.type == NUM && t.text.size() <= 3) {
+            unsigned n = 0;
+            for (char c : t.text) n = n * 10 + static_cast<unsigned>(c - '0');
+            if (n <= MAX_ARRAY_LENGTH && t.text.find('.') == std::string_view::npos)
+                st.decl_length = static_cast<uint8_t>(n);
+        }
+        mix(static_cast<uint64_t>(t.type) << 56 | t.text.size());
+        for (size_t i = 0; i < t.text.size(); i += 8) {
+            uint64_t w = 0;
+            std::memcpy(&w, t.text.data() + i, std::min<size_t>(8, t.text.size() - i));
+            mix(w);
+        }
+        prev[2] = prev[1];
+        prev[1] = prev[0];
+        prev[0] = t.type;
     }
-}; // end ParserImpl
-
-} // end anonymous namespace
-
-// Implementazione di Parser::parse fuori dal namespace anonimo
-std::unique_ptr<Expr> Parser::parse(const std::string& line) {
-    return ParserImpl(line).parse();
-}
\ No newline at end of file
+    return scan;
+}
@@ -1,189 +1,204 @@
 #pragma once
-#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <cstdint>
 #include <stdexcept>
-#include <sstream>
 #include <vector>
 
-enum class VoltType { INT, FLOAT, DOUBLE };
+// int is a signed 32-bit integer; I8..I64 are the other signed widths and
+// U8..U64 the unsigned ones. The first three keep their values, which
+// .voltc files and cache entries store.
+enum class VoltType : uint8_t { INT, FLOAT, DOUBLE, I8, I16, I64, U8, U16, U32, U64 };
+constexpr int VOLT_TYPE_COUNT = 10;
+
+inline bool isFloatType(VoltType t) { return t == VoltType::FLOAT || t == VoltType::DOUBLE; }
+inline bool isUnsignedType(VoltType t) { return t >= VoltType::U8; }
+
+// Width in bits of an integer type.
+inline unsigned intBits(VoltType t) {
+    switch (t) {
+        case VoltType::I8: case VoltType::U8: return 8;
+        case VoltType::I16: case VoltType::U16: return 16;
+        case VoltType::I64: case VoltType::U64: return 64;
+        default: return 32;
+    }
+}
 
 inline std::string voltTypeToLLVM(VoltType t) {
     switch (t) {
-        case VoltType::INT: return "i32";
         case VoltType::FLOAT: return "float";
         case VoltType::DOUBLE: return "double";
+        case VoltType::I8: case VoltType::U8: return "i8";
+        case VoltType::I16: case VoltType::U16: return "i16";
+        case VoltType::I64: case VoltType::U64: return "i64";
+        default: return "i32";
     }
-    return "i32";
+}
+
+// Longest array type, so a length fits in Node::flags.
+constexpr uint32_t MAX_ARRAY_LENGTH = 255;
+
+// LLVM type of a value of element type t: a scalar, or a vector of `length`
+// elements for an array.
+inline std::string voltTypeToLLVM(VoltType t, uint8_t length) {
+    if (length == 0) return voltTypeToLLVM(t);
+    return '<' + std::to_string(length) + " x " + voltTypeToLLVM(t) + '>';
 }
 
 enum TokenType {
-    END, NUM, ID, WHAT, COLON, TYPE, ASSIGN,
-    PLUS, MINUS, MUL, DIV, MOD, AND, OR, LPAREN, RPAREN, SEMICOLON
+    NUM, ID, WHAT, COLON, TYPE, ASSIGN, PLUS, MINUS, MUL, DIV, MOD,
+    AND, OR, LPAREN, RPAREN, END, SEMICOLON,
+    IF, THEN, ELSE, ELSEIF, ENDIF,
+    GT, LT, GTE, LTE, DI, EQ,
+    LBRACKET, RBRACKET, COMMA, FOR, FROM, UNTIL, DO, ENDFOR,
+    SHL // never produced by the lexer: x * 2^k rewritten by the optimizer
 };
 
+// Variables in scope, in flat vectors indexed by symbol id (the string id
+// the lexer interned the name under).
 struct Context {
-    std::unordered_map<std::string, VoltType> var_types;
+    std::vector<VoltType> var_types;
+    std::vector<bool> declared;
+    std::vector<uint8_t> lengths; // array length, 0 for a scalar
     int temp_index = 0;
+    void resize(size_t symbols) {
+        var_types.resize(symbols, VoltType::INT);
+        declared.resize(symbols, false);
+        lengths.resize(symbols, 0);
+    }
 };
 
-struct Expr {
-    virtual ~Expr() = default;
-    virtual VoltType getType(Context& ctx) const = 0;
-    virtual std::string toLLVMIR(Context& ctx, std::string& result_var) const = 0;
-};
+// ---- Flat AST -------------------------------------------------------------
+//
+// All nodes of a module live in one vector and refer to each other through
+// 32-bit indices, so a module is a handful of contiguous arrays that are
+// freed at once. Identifiers and literal texts are interned in a StringPool.
 
-struct Number : Expr {
-    std::string text;
+enum class NodeKind : uint8_t { NUMBER, VARIABLE, BINOP, LOGICOP, VAR_DECL, IF, CONVERT, CONST, ARRAY, INDEX, SPLAT, FOR };
+
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// Meaning of the operands per kind (type is the resolved type once Sema ran;
+// for arrays, the element type, with the length in flags):
+//   NUMBER    a = literal text (string id), type = literal type
+//   VARIABLE  a = name (string id)
+//   BINOP     a = left, b = right, op = PLUS..OR or SHL
+//   LOGICOP   a = left, b = right, op = GT..EQ
+//   VAR_DECL  a = name (string id), b = value, type = declared type
+//   IF        a = first IfBranch record in Ast::extra, b = branch count
+//   CONVERT   a = operand, type = target type (int->float->double promotion)
+//   CONST     folded value: int32 or float bits in a, double bits in a (low) and b (high)
+//   ARRAY     literal [x, y, ...]: elements are extra[a .. a+b)
+//   INDEX     a = array, b = index (int), type = element type
+//   SPLAT     a = scalar operand repeated over an array of length flags
+//   FOR       a = ForLoop record in Ast::extra
+struct Node {
+    NodeKind kind;
+    uint8_t op;
     VoltType type;
-    Number(const std::string& t, VoltType tp) : text(t), type(tp) {}
-    VoltType getType(Context&) const override { return type; }
-    std::string toLLVMIR(Context&, std::string& result_var) const override {
-        result_var = "%t" + std::to_string(rand() % 10000);
-        std::ostringstream oss;
-        if (type == VoltType::INT)
-            oss << result_var << " = add i32 0, " << text;
-        else if (type == VoltType::FLOAT)
-            oss << result_var << " = fadd float 0.0, " << text << " ; float";
-        else if (type == VoltType::DOUBLE)
-            oss << result_var << " = fadd double 0.0, " << text << " ; double";
-        return oss.str();
-    }
+    uint8_t flags; // array length of the value, 0 for a scalar; VAR_DECL: declared length
+    uint32_t a, b;
 };
+static_assert(sizeof(Node) == 12, "Node should stay compact");
 
-struct Variable : Expr {
-    std::string name;
-    Variable(const std::string& n) : name(n) {}
-    VoltType getType(Context& ctx) const override {
-        auto it = ctx.var_types.find(name);
-        if (it == ctx.var_types.end()) throw std::runtime_error("Undefined variable: " + name);
-        return it->second;
-    }
-    std::string toLLVMIR(Context&, std::string& result_var) const override {
-        result_var = "%" + name;
-        return "; uso variabile " + name;
+// Branch of an if/elseif/else, stored as three words in Ast::extra.
+// cond is NO_NODE for 'else'; the statements are extra[first .. first+count).
+struct IfBranch {
+    uint32_t cond, first, count;
+};
+
+// `for var from .. until ..`, stored as five words in Ast::extra; the body
+// is extra[first .. first+count), like a branch's.
+struct ForLoop {
+    uint32_t var, from, until, first, count;
+    IfBranch body() const { return {NO_NODE, first, count}; }
+};
+
+// Interns string views; the viewed text (the source file) must outlive the pool.
+class StringPool {
+    std::vector<std::string_view> strings;
+    std::vector<uint32_t> slots; // open addressing, holds id + 1, 0 = empty
+    void grow();
+public:
+    uint32_t intern(std::string_view s);
+    // Replaces the contents with strings that are already distinct, keeping
+    // their ids (a pool read back from a .voltc file). The hash table is
+    // only rebuilt if something is interned later.
+    void assign(std::vector<std::string_view> distinct);
+    std::string_view get(uint32_t id) const { return strings[id]; }
+    size_t size() const { return strings.size(); }
+    size_t memoryUsage() const {
+        return strings.capacity() * sizeof(std::string_view) + slots.capacity() * sizeof(uint32_t);
     }
 };
 
-struct BinOp : Expr {
-    TokenType op;
-    std::unique_ptr<Expr> left, right;
-    BinOp(TokenType op, std::unique_ptr<Expr> l, std::unique_ptr<Expr> r)
-        : op(op), left(std::move(l)), right(std::move(r)) {}
-<<<<<<< HEAD
-    VoltType getType(Context& ctx) const override {
-        VoltType lt = left->getType(ctx), rt = right->getType(ctx);
-        if (lt == VoltType::DOUBLE || rt == VoltType::DOUBLE) return VoltType::DOUBLE;
-        if (lt == VoltType::FLOAT || rt == VoltType::FLOAT) return VoltType::FLOAT;
-        return VoltType::INT;
+struct Ast {
+    std::vector<Node> nodes;
+    std::vector<uint32_t> extra;
+    StringPool strings;
+    std::vector<uint32_t> roots;   // top-level statements
+    std::vector<uint32_t> offsets; // source offset of each top-level statement
+
+    uint32_t add(const Node& n) {
+        nodes.push_back(n);
+        return static_cast<uint32_t>(nodes.size() - 1);
     }
-    std::string toLLVMIR(Context& ctx, std::string& result_var) const override {
-        std::string lvar, rvar;
-        std::ostringstream oss;
-        oss << left->toLLVMIR(ctx, lvar) << "\n";
-        oss << right->toLLVMIR(ctx, rvar) << "\n";
-        VoltType t = getType(ctx);
-        std::string llvmT = voltTypeToLLVM(t);
-        result_var = "%t" + std::to_string(++ctx.temp_index);
-
-        // Floating point or integer operation
-        bool isFloat = (t == VoltType::FLOAT || t == VoltType::DOUBLE);
-        std::string opstr;
-        switch(op) {
-        case 6: opstr = isFloat ? "fadd" : "add"; break;
-        case 7: opstr = isFloat ? "fsub" : "sub"; break;
-        case 8: opstr = isFloat ? "fmul" : "mul"; break;
-        case 9: opstr = isFloat ? "fdiv" : "sdiv"; break;
-        case 10: opstr = isFloat ? "frem" : "srem"; break;
-        case 11: { // AND logico (&&)
-            std::string lbool = "%t" + std::to_string(++ctx.temp_index);
-            std::string rbool = "%t" + std::to_string(++ctx.temp_index);
-            std::string andres = "%t" + std::to_string(++ctx.temp_index);
-            result_var = "%t" + std::to_string(++ctx.temp_index);
-            oss << lbool << " = icmp ne " << llvmT << " " << lvar << ", 0\n";
-            oss << rbool << " = icmp ne " << llvmT << " " << rvar << ", 0\n";
-            oss << andres << " = and i1 " << lbool << ", " << rbool << "\n";
-            oss << result_var << " = zext i1 " << andres << " to i32";
-            return oss.str();
-        }
-        case 12: { // OR logico (||)
-            std::string lbool = "%t" + std::to_string(++ctx.temp_index);
-            std::string rbool = "%t" + std::to_string(++ctx.temp_index);
-            std::string orres = "%t" + std::to_string(++ctx.temp_index);
-            result_var = "%t" + std::to_string(++ctx.temp_index);
-            oss << lbool << " = icmp ne " << llvmT << " " << lvar << ", 0\n";
-            oss << rbool << " = icmp ne " << llvmT << " " << rvar << ", 0\n";
-            oss << orres << " = or i1 " << lbool << ", " << rbool << "\n";
-            oss << result_var << " = zext i1 " << orres << " to i32";
-            return oss.str();
-        }
-        default: opstr = isFloat ? "fadd" : "add";
-        }
-        oss << result_var << " = " << opstr << " " << llvmT << " " << lvar << ", " << rvar;
-        return oss.str();
-=======
-    int eval(Context& ctx) const override {
-        int a = left->eval(ctx), b = right->eval(ctx);
-        switch(op) {
-        case PLUS:
-            return a + b;
-        case MINUS:
-            return a - b;
-        case MUL:
-            return a * b;
-        case DIV:
-            if (b == 0) throw std::runtime_error("Division by zero");
-            return a / b;
-        case MOD:
-            if (b == 0) throw std::runtime_error("Modulo by zero");
-            return a % b;
-        case AND:
-            return a && b;
-        case OR:
-            return a || b;
-        default:
-            throw std::runtime_error("Unknown operator");
-        }
+    const Node& operator[](uint32_t i) const { return nodes[i]; }
+    std::string_view str(uint32_t id) const { return strings.get(id); }
+    IfBranch branch(const Node& ifNode, uint32_t i) const {
+        const uint32_t* w = &extra[ifNode.a + 3 * i];
+        return {w[0], w[1], w[2]};
     }
-    bool is_logical() const override {
-        return op == AND || op == OR;
->>>>>>> origin/testing
+    uint32_t stmt(const IfBranch& br, uint32_t i) const { return extra[br.first + i]; }
+    ForLoop loop(const Node& forNode) const {
+        const uint32_t* w = &extra[forNode.a];
+        return {w[0], w[1], w[2], w[3], w[4]};
+    }
+    size_t memoryUsage() const {
+        return nodes.capacity() * sizeof(Node) + extra.capacity() * sizeof(uint32_t) +
+               strings.memoryUsage() + (roots.capacity() + offsets.capacity()) * sizeof(uint32_t);
     }
 };
 
-struct VarDeclaration : Expr {
-    std::string name;
-    VoltType type;
-    std::unique_ptr<Expr> expr;
-    VarDeclaration(const std::string& n, VoltType t, std::unique_ptr<Expr> e)
-        : name(n), type(t), expr(std::move(e)) {}
-    VoltType getType(Context&) const override { return type; }
-    std::string toLLVMIR(Context& ctx, std::string& result_var) const override {
-        std::string expr_var;
-        std::ostringstream oss;
-        oss << expr->toLLVMIR(ctx, expr_var) << "\n";
-        std::string llvmT = voltTypeToLLVM(type);
-        oss << "%" << name << " = alloca " << llvmT << "\n";
-        oss << "store " << llvmT << " " << expr_var << ", " << llvmT << "* %" << name;
-        ctx.var_types[name] = type;
-        result_var = "%" + name;
-        return oss.str();
-    }
+// Error raised by the front end; offset is the byte position in the source.
+struct ParseError : std::runtime_error {
+    uint32_t offset;
+    ParseError(const std::string& msg, uint32_t off) : std::runtime_error(msg), offset(off) {}
 };
 
-struct IfStatement : Expr {
-    struct Branch {
-        std::unique_ptr<Expr> condition; // nullptr for 'else'
-        std::vector<std::unique_ptr<Expr>> statements;
-    };
-    std::vector<Branch> branches;
-    VoltType getType(Context&) const override { return VoltType::INT; }
-    std::string toLLVMIR(Context&, std::string&) const override {
-        return "; IF/ELSEIF/ELSE not yet implemented in IR";
-    }
+// A top-level statement as seen by Parser::scanStatements.
+struct StatementInfo {
+    uint32_t begin, end; // source range of its tokens; end is just past the ';'
+    uint64_t hash;       // of the token sequence, independent of layout
+    uint32_t decl;       // variable declared by a `what` statement, or NO_NODE
+    VoltType decl_type;
+    uint8_t decl_length; // array length of decl, 0 for a scalar
+    uint32_t first_ref, refs; // identifiers used, as a range of StatementScan::refs
+};
+
+struct StatementScan {
+    StringPool names; // ids of StatementInfo::decl and refs
+    std::vector<StatementInfo> statements;
+    std::vector<uint32_t> refs;
 };
 
 class Parser {
 public:
-    static std::unique_ptr<Expr> parse(const std::string& line);
+    // Lexes and parses the entire source in one pass. Tokens and interned
+    // strings are views into `source`, so it must outlive the returned Ast.
+    static Ast parseProgram(std::string_view source);
+    // Runs only the lexer (including identifier interning) and returns the
+    // number of tokens; the benchmark uses it to time lexing on its own.
+    static size_t countTokens(std::string_view source);
+    // Offsets just after the ';' of top-level statements at which `source`
+    // can be cut into pieces of about `target` bytes, each a program of its
+    // own. Only the first word of every statement is looked at (if / endif
+    // and for / endfor nesting), so this is much cheaper than lexing; on
+    // malformed input a piece simply fails to parse.
+    static std::vector<size_t> splitPoints(std::string_view source, size_t target);
+    // Lexes the source and groups the tokens into top-level statements
+    // (an if or for statement with everything up to its endif / endfor is
+    // one) without parsing them. Tokens after the last ';' form a
+    // statement of their own. Throws ParseError on an invalid character.
+    static StatementScan scanStatements(std::string_view source);
 };
@@ -0,0 +1,142 @@
+#include "scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VOLT_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum class Run { SPACE, IDENT, DIGIT, NOT_SEMI };
+
+template <Run R>
+inline bool inRun(unsigned char b) {
+    if (R == Run::NOT_SEMI) return b != ';';
+    uint8_t c = BYTE_CLASSES.c[b];
+    if (R == Run::SPACE) return c & CLASS_SPACE;
+    if (R == Run::DIGIT) return c & CLASS_DIGIT;
+    return c & (CLASS_ALPHA | CLASS_DIGIT);
+}
+
+template <Run R>
+size_t runScalar(const char* p, size_t i, size_t n) {
+    while (i < n && inRun<R>(static_cast<unsigned char>(p[i]))) ++i;
+    return i;
+}
+
+#ifdef VOLT_SCAN_X86
+
+// x in [lo, lo + span] as an unsigned byte range check: (x - lo) <= span.
+inline __m128i rangeSse2(__m128i x, char lo, char span) {
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(span)), d);
+}
+
+template <Run R>
+inline __m128i matchSse2(__m128i x) {
+    if (R == Run::NOT_SEMI) return _mm_xor_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(';')), _mm_set1_epi8(-1));
+    if (R == Run::SPACE)
+        return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), rangeSse2(x, '\t', '\r' - '\t'));
+    __m128i digit = rangeSse2(x, '0', 9);
+    if (R == Run::DIGIT) return digit;
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20)); // folds A-Z onto a-z
+    __m128i alpha = rangeSse2(lower, 'a', 25);
+    return _mm_or_si128(_mm_or_si128(digit, alpha), _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+template <Run R>
+size_t runSse2(const char* p, size_t i, size_t n) {
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        uint32_t stop = ~static_cast<uint32_t>(_mm_movemask_epi8(matchSse2<R>(x))) & 0xFFFFu;
+        if (stop) return i + __builtin_ctz(stop);
+    }
+    return runScalar<R>(p, i, n);
+}
+
+__attribute__((target("avx2"))) inline __m256i rangeAvx2(__m256i x, char lo, char span) {
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(span)), d);
+}
+
+template <Run R>
+__attribute__((target("avx2"))) inline __m256i matchAvx2(__m256i x) {
+    if (R == Run::NOT_SEMI) return _mm256_xor_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(';')), _mm256_set1_epi8(-1));
+    if (R == Run::SPACE)
+        return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), rangeAvx2(x, '\t', '\r' - '\t'));
+    __m256i digit = rangeAvx2(x, '0', 9);
+    if (R == Run::DIGIT) return digit;
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i alpha = rangeAvx2(lower, 'a', 25);
+    return _mm256_or_si256(_mm256_or_si256(digit, alpha), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+template <Run R>
+__attribute__((target("avx2"))) size_t runAvx2(const char* p, size_t i, size_t n) {
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(matchAvx2<R>(x)));
+        if (stop) return i + __builtin_ctz(stop);
+    }
+    return runSse2<R>(p, i, n);
+}
+
+#endif // VOLT_SCAN_X86
+
+struct Kernels {
+    size_t (*space)(const char*, size_t, size_t);
+    size_t (*ident)(const char*, size_t, size_t);
+    size_t (*digit)(const char*, size_t, size_t);
+    size_t (*semi)(const char*, size_t, size_t);
+    const char* name;
+};
+
+constexpr Kernels SCALAR = {runScalar<Run::SPACE>, runScalar<Run::IDENT>, runScalar<Run::DIGIT>,
+                             runScalar<Run::NOT_SEMI>, "scalar"};
+#ifdef VOLT_SCAN_X86
+constexpr Kernels SSE2 = {runSse2<Run::SPACE>, runSse2<Run::IDENT>, runSse2<Run::DIGIT>, runSse2<Run::NOT_SEMI>,
+                          "sse2"};
+constexpr Kernels AVX2 = {runAvx2<Run::SPACE>, runAvx2<Run::IDENT>, runAvx2<Run::DIGIT>, runAvx2<Run::NOT_SEMI>,
+                          "avx2"};
+
+bool hasAvx2() {
+    __builtin_cpu_init(); // runs from a static initializer
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+Kernels selectKernels() {
+#ifdef VOLT_SCAN_X86
+    return hasAvx2() ? AVX2 : SSE2;
+#else
+    return SCALAR;
+#endif
+}
+
+Kernels KERNELS = selectKernels();
+
+} // namespace
+
+size_t skipSpace(std::string_view text, size_t pos) { return KERNELS.space(text.data(), pos, text.size()); }
+size_t scanIdent(std::string_view text, size_t pos) { return KERNELS.ident(text.data(), pos, text.size()); }
+size_t scanDigits(std::string_view text, size_t pos) { return KERNELS.digit(text.data(), pos, text.size()); }
+size_t findTerminator(std::string_view text, size_t pos) { return KERNELS.semi(text.data(), pos, text.size()); }
+
+namespace scalar {
+size_t skipSpace(std::string_view text, size_t pos) { return runScalar<Run::SPACE>(text.data(), pos, text.size()); }
+size_t scanIdent(std::string_view text, size_t pos) { return runScalar<Run::IDENT>(text.data(), pos, text.size()); }
+size_t scanDigits(std::string_view text, size_t pos) { return runScalar<Run::DIGIT>(text.data(), pos, text.size()); }
+size_t findTerminator(std::string_view text, size_t pos) { return runScalar<Run::NOT_SEMI>(text.data(), pos, text.size()); }
+} // namespace scalar
+
+const char* scanBackend() { return KERNELS.name; }
+
+bool setScanBackend(std::string_view name) {
+    if (name == "scalar") KERNELS = SCALAR;
+#ifdef VOLT_SCAN_X86
+    else if (name == "sse2") KERNELS = SSE2;
+    else if (name == "avx2" && hasAvx2()) KERNELS = AVX2;
+#endif
+    else return false;
+    return true;
+}
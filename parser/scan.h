@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Byte-class scanning for the lexer. Each function returns the first
+// position at or after `pos` whose byte is NOT in the class (or text.size()).
+// The classes are fixed ASCII sets, independent of the C locale:
+//   space  ' ', \t, \n, \v, \f, \r (what std::isspace accepts in the "C" locale)
+//   ident  [A-Za-z0-9_]
+//   digit  [0-9]
+// On x86-64 the runs are classified 16 bytes at a time with SSE2, or 32 with
+// AVX2 when the CPU has it (checked once at startup). The scalar versions are
+// the reference: the vector paths must return exactly the same positions.
+size_t skipSpace(std::string_view text, size_t pos);
+size_t scanIdent(std::string_view text, size_t pos);
+size_t scanDigits(std::string_view text, size_t pos);
+// First ';' at or after `pos`, or text.size(): statement boundaries for
+// splitting a source before it is lexed.
+size_t findTerminator(std::string_view text, size_t pos);
+
+namespace scalar {
+size_t skipSpace(std::string_view text, size_t pos);
+size_t scanIdent(std::string_view text, size_t pos);
+size_t scanDigits(std::string_view text, size_t pos);
+size_t findTerminator(std::string_view text, size_t pos);
+} // namespace scalar
+
+// "avx2", "sse2" or "scalar".
+const char* scanBackend();
+// Makes the functions above use the named backend; false if this build or
+// CPU lacks it. For tests that compare each backend with scalar::; not
+// safe while other threads are scanning.
+bool setScanBackend(std::string_view name);
+
+// Single-byte tests with the same classes, from a table built at compile time.
+enum : uint8_t { CLASS_SPACE = 1, CLASS_DIGIT = 2, CLASS_ALPHA = 4 /* letters and '_' */ };
+
+struct ByteClasses {
+    uint8_t c[256];
+};
+
+constexpr ByteClasses buildByteClasses() {
+    ByteClasses t{};
+    for (int b = 0; b < 256; ++b) {
+        uint8_t v = 0;
+        if (b == ' ' || (b >= '\t' && b <= '\r')) v |= CLASS_SPACE;
+        if (b >= '0' && b <= '9') v |= CLASS_DIGIT;
+        if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_') v |= CLASS_ALPHA;
+        t.c[b] = v;
+    }
+    return t;
+}
+
+inline constexpr ByteClasses BYTE_CLASSES = buildByteClasses();
+
+inline bool isDigit(char c) { return BYTE_CLASSES.c[static_cast<unsigned char>(c)] & CLASS_DIGIT; }
+inline bool isIdentStart(char c) { return BYTE_CLASSES.c[static_cast<unsigned char>(c)] & CLASS_ALPHA; }
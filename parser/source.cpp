@@ -0,0 +1,80 @@
+#include "source.h"
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::SourceFile(const std::string& path) {
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Could not open file " + path);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    buffer_ = ss.str();
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    // Token offsets are stored as 32-bit values.
+    if (size_ > UINT32_MAX) throw std::runtime_error("File too large: " + path);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Could not open file " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat file " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    // Token offsets are stored as 32-bit values. Checked before mapping: the
+    // destructor does not run when the constructor throws.
+    if (size_ > UINT32_MAX) {
+        ::close(fd);
+        throw std::runtime_error("File too large: " + path);
+    }
+    if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Could not map file " + path);
+        }
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(p);
+    }
+    ::close(fd);
+#endif
+}
+
+SourceFile::~SourceFile() {
+#ifndef _WIN32
+    if (data_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+size_t lineOf(std::string_view text, size_t offset) {
+    size_t line = 1;
+    for (size_t i = 0; i < offset && i < text.size(); ++i)
+        if (text[i] == '\n') ++line;
+    return line;
+}
+
+std::string_view lineAt(std::string_view t, size_t offset) {
+    if (offset > t.size()) offset = t.size();
+    size_t begin = 0;
+    if (offset > 0) {
+        size_t nl = t.rfind('\n', offset - 1);
+        if (nl != std::string_view::npos) begin = nl + 1;
+    }
+    size_t end = t.find('\n', offset);
+    if (end == std::string_view::npos) end = t.size();
+    std::string_view line = t.substr(begin, end - begin);
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+        line.remove_suffix(1);
+    return line;
+}
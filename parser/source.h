@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// 1-based line number containing the given byte offset.
+size_t lineOf(std::string_view text, size_t offset);
+// Full text of the line containing the given byte offset, without the newline.
+std::string_view lineAt(std::string_view text, size_t offset);
+
+// Read-only view of a whole source file. On POSIX systems the file is
+// memory-mapped, so tokens can point straight into it without copies.
+class SourceFile {
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    std::string buffer_;
+#endif
+public:
+    SourceFile() = default;
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view text() const { return std::string_view(data_, size_); }
+
+    size_t lineOf(size_t offset) const { return ::lineOf(text(), offset); }
+    std::string_view lineAt(size_t offset) const { return ::lineAt(text(), offset); }
+};
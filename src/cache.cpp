@@ -0,0 +1,323 @@
+#include "cache.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "pool.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bumped whenever the IR emitted for a chunk, or the entry layout, changes.
+constexpr uint64_t CACHE_FORMAT = 4;
+// Average statements per chunk, and the most a chunk can hold.
+constexpr uint64_t CACHE_CHUNK_STMTS = 256;
+constexpr size_t CACHE_CHUNK_MAX = 4 * CACHE_CHUNK_STMTS;
+
+struct Hasher {
+    uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+    void byte(uint64_t b) { h = (h ^ b) * 0x100000001b3ull; }
+    void word(uint64_t w) {
+        for (int i = 0; i < 8; ++i) byte((w >> (8 * i)) & 0xff);
+    }
+    void text(std::string_view s) {
+        for (char c : s) byte(static_cast<unsigned char>(c));
+        byte(0x100);
+    }
+};
+
+std::string hex(uint64_t key) {
+    char buf[17];
+    std::snprintf(buf, sizeof buf, "%016llx", static_cast<unsigned long long>(key));
+    return buf;
+}
+
+// Prefix of every name in a chunk's IR. Only the low 32 bits of the key, as
+// long names make IR emission measurably slower; compileCached makes the
+// names of one file distinct.
+std::string chunkName(uint64_t key) { return 'c' + hex(key).substr(8); }
+
+// Reads the header of a cache entry: lines of space-separated fields.
+struct Fields {
+    std::string_view data;
+    size_t next = 0;       // start of the following line
+    std::string_view rest; // unread part of the current line
+
+    bool line() {
+        size_t nl = data.find('\n', next);
+        if (nl == std::string_view::npos) return false;
+        rest = data.substr(next, nl - next);
+        next = nl + 1;
+        return true;
+    }
+    bool text(std::string_view& f) {
+        size_t sp = rest.find(' ');
+        f = rest.substr(0, sp);
+        rest = sp == std::string_view::npos ? std::string_view() : rest.substr(sp + 1);
+        return !f.empty();
+    }
+    bool text(std::string& f) {
+        std::string_view v;
+        if (!text(v)) return false;
+        f.assign(v.data(), v.size());
+        return true;
+    }
+    // The rest of the line, which may contain spaces.
+    bool tail(std::string& f) {
+        f.assign(rest.data(), rest.size());
+        rest = {};
+        return !f.empty();
+    }
+    template <class T>
+    bool number(T& n) {
+        std::string_view v;
+        return text(v) && std::from_chars(v.data(), v.data() + v.size(), n).ptr == v.data() + v.size();
+    }
+};
+
+// A chunk of the source before compilation: its text, cache key and the
+// earlier top-level variables it refers to.
+struct Plan {
+    std::string_view text;
+    uint64_t key;
+    std::vector<uint32_t> inherited; // StatementScan::names ids
+};
+
+} // namespace
+
+IrCache::IrCache(std::string directory) : dir(std::move(directory)) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) throw std::runtime_error("Could not create cache directory " + dir + ": " + ec.message());
+}
+
+std::string IrCache::path(uint64_t key) const { return (fs::path(dir) / (hex(key) + ".vc")).string(); }
+
+// Entry layout, all text:
+//   voltcache <format>
+//   <name> <last block> <instructions> <removed> <temporaries> <used> <exports> <ir bytes>
+//   one line "<name> <type> <length>" per used variable
+//   one line "<name> <type> <length> <value>" per export (the value, an
+//   array constant, may contain spaces)
+//   the IR
+bool IrCache::load(uint64_t key, ChunkIr& chunk) {
+    std::string data;
+    if (std::ifstream f{path(key), std::ios::binary | std::ios::ate}) {
+        data.resize(static_cast<size_t>(f.tellg()));
+        f.seekg(0);
+        f.read(&data[0], static_cast<std::streamsize>(data.size()));
+        if (!f) data.clear();
+    }
+    Fields in{data, 0, {}};
+    std::string_view magic;
+    uint64_t format = 0;
+    size_t used = 0, exports = 0, ir_bytes = 0;
+    bool ok = in.line() && in.text(magic) && magic == "voltcache" && in.number(format) && format == CACHE_FORMAT &&
+              in.line() && in.text(chunk.name) && chunk.name == chunkName(key) && in.text(chunk.last_block) &&
+              in.number(chunk.instructions) && in.number(chunk.removed) && in.number(chunk.temporaries) &&
+              in.number(used) && in.number(exports) && in.number(ir_bytes);
+    auto var = [&](ChunkIr::Var& v, bool value) {
+        int type = -1;
+        unsigned length = 0;
+        ok = ok && in.line() && in.text(v.name) && in.number(type) && in.number(length) &&
+             (!value || in.tail(v.value)) && type >= 0 && type < VOLT_TYPE_COUNT &&
+             length <= MAX_ARRAY_LENGTH;
+        v.type = static_cast<VoltType>(type);
+        v.length = static_cast<uint8_t>(length);
+    };
+    chunk.used.assign(ok ? used : 0, {});
+    for (ChunkIr::Var& v : chunk.used) var(v, false);
+    chunk.exports.assign(ok ? exports : 0, {});
+    for (ChunkIr::Var& v : chunk.exports) var(v, true);
+    if (!ok || data.size() - in.next != ir_bytes) {
+        ++miss_count;
+        return false;
+    }
+    data.erase(0, in.next);
+    chunk.ir = std::move(data);
+    std::error_code ec;
+    fs::last_write_time(path(key), fs::file_time_type::clock::now(), ec);
+    ++hit_count;
+    return true;
+}
+
+void IrCache::store(uint64_t key, const ChunkIr& chunk) {
+    std::string final_path = path(key);
+    std::ostringstream tid;
+    tid << std::this_thread::get_id();
+    std::string tmp = final_path + ".tmp" + tid.str();
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        f << "voltcache " << CACHE_FORMAT << '\n'
+          << chunk.name << ' ' << chunk.last_block << ' ' << chunk.instructions << ' ' << chunk.removed << ' '
+          << chunk.temporaries << ' ' << chunk.used.size() << ' ' << chunk.exports.size() << ' ' << chunk.ir.size()
+          << '\n';
+        for (const ChunkIr::Var& v : chunk.used)
+            f << v.name << ' ' << static_cast<int>(v.type) << ' ' << static_cast<int>(v.length) << '\n';
+        for (const ChunkIr::Var& v : chunk.exports)
+            f << v.name << ' ' << static_cast<int>(v.type) << ' ' << static_cast<int>(v.length) << ' ' << v.value
+              << '\n';
+        f << chunk.ir;
+        if (!f) {
+            f.close();
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, final_path, ec);
+    if (ec) fs::remove(tmp, ec);
+}
+
+IrCache::Usage IrCache::trim(uint64_t limit) const {
+    struct Entry {
+        fs::file_time_type time;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    Usage usage;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != ".vc") continue;
+        std::error_code e;
+        Entry entry{it->last_write_time(e), it->file_size(e), it->path()};
+        if (e) continue;
+        usage.bytes += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    size_t oldest = 0;
+    for (; oldest < entries.size() && usage.bytes > limit; ++oldest) {
+        if (!fs::remove(entries[oldest].path, ec)) continue;
+        usage.bytes -= entries[oldest].size;
+        ++usage.evicted;
+    }
+    usage.entries = entries.size() - usage.evicted;
+    return usage;
+}
+
+bool compileCached(std::string_view source, ChunkStore& cache, bool fold, const CodeGenOptions& gen,
+                   WorkStealingPool* pool,
+                   Profiler& prof, SplitModule& module, size_t& hits, size_t& misses) {
+    StatementScan scan;
+    try {
+        Profiler::Scope phase(prof, "scan");
+        scan = Parser::scanStatements(source);
+    } catch (const ParseError&) {
+        return false;
+    }
+
+    std::vector<Plan> plans;
+    // VoltType | array length << 8 of the top-level variables, or -1
+    std::vector<int> global_type(scan.names.size(), -1);
+    {
+        Profiler::Scope phase(prof, "split");
+        std::unordered_map<uint64_t, uint64_t> seen_keys; // key -> occurrences, for repeated chunks
+        std::unordered_set<std::string> names;
+        std::vector<char> referenced(scan.names.size());
+        std::vector<uint32_t> refs;
+        size_t first = 0;
+        uint32_t begin = 0;
+        for (size_t i = 0; i < scan.statements.size(); ++i) {
+            const StatementInfo& last = scan.statements[i];
+            bool end = i + 1 == scan.statements.size();
+            if (!end && (last.hash >> 32) % CACHE_CHUNK_STMTS != 0 && i + 1 - first < CACHE_CHUNK_MAX) continue;
+
+            Plan plan{source.substr(begin, end ? std::string_view::npos : last.end - begin), 0, {}};
+            Hasher h;
+            h.word(CACHE_FORMAT);
+            h.byte(fold);
+            h.byte(gen.switches);
+            h.byte(gen.cse);
+            h.byte(gen.fast_math);
+            refs.clear();
+            for (size_t k = first; k <= i; ++k) {
+                const StatementInfo& st = scan.statements[k];
+                h.word(st.hash);
+                for (uint32_t r = st.first_ref; r < st.first_ref + st.refs; ++r)
+                    if (!referenced[scan.refs[r]]) {
+                        referenced[scan.refs[r]] = 1;
+                        refs.push_back(scan.refs[r]);
+                    }
+            }
+            for (uint32_t sym : refs) {
+                referenced[sym] = 0;
+                if (global_type[sym] < 0) continue;
+                h.text(scan.names.get(sym));
+                h.byte(static_cast<uint8_t>(global_type[sym]));
+                h.byte(static_cast<uint8_t>(global_type[sym] >> 8));
+                plan.inherited.push_back(sym);
+            }
+            for (size_t k = first; k <= i; ++k) {
+                const StatementInfo& st = scan.statements[k];
+                if (st.decl != NO_NODE && global_type[st.decl] < 0)
+                    global_type[st.decl] = static_cast<int>(st.decl_type) | st.decl_length << 8;
+            }
+            // A chunk that repeats an earlier one, or whose name would, gets
+            // a salted key; the salt depends only on the chunks before it.
+            for (uint64_t salt = seen_keys[h.h]++;; ++salt) {
+                Hasher salted = h;
+                if (salt > 0) salted.word(salt);
+                plan.key = salted.h;
+                if (names.insert(chunkName(plan.key)).second) break;
+            }
+            plans.push_back(std::move(plan));
+            first = i + 1;
+            begin = last.end;
+        }
+        if (plans.empty()) plans.push_back({source, Hasher().h, {}});
+    }
+
+    std::vector<ChunkIr> irs(plans.size());
+    std::vector<size_t> missed;
+    {
+        Profiler::Scope phase(prof, "cache");
+        for (size_t i = 0; i < plans.size(); ++i)
+            if (!cache.load(plans[i].key, irs[i])) missed.push_back(i);
+    }
+    hits = plans.size() - missed.size();
+    misses = missed.size();
+
+    std::vector<char> ok(missed.size(), 1);
+    std::vector<size_t> nodes(missed.size());
+    {
+        Profiler::Scope phase(prof, "codegen");
+        auto compile = [&](size_t m, unsigned) {
+            size_t i = missed[m];
+            Chunk c;
+            c.text = plans[i].text;
+            c.out.name = chunkName(plans[i].key);
+            ok[m] = parseChunk(c);
+            if (!ok[m]) return;
+            VarTypes globals;
+            for (uint32_t sym : plans[i].inherited)
+                globals.emplace(scan.names.get(sym), VarType{static_cast<VoltType>(global_type[sym] & 0xff),
+                                                             static_cast<uint8_t>(global_type[sym] >> 8)});
+            inheritVariables(c, globals);
+            ok[m] = lowerChunk(c, fold, gen);
+            if (!ok[m]) return;
+            nodes[m] = c.ast.nodes.size();
+            cache.store(plans[i].key, c.out);
+            irs[i] = std::move(c.out);
+        };
+        if (pool) {
+            pool->parallelFor(missed.size(), compile);
+        } else {
+            for (size_t m = 0; m < missed.size(); ++m) compile(m, 0);
+        }
+    }
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) return false;
+
+    Profiler::Scope phase(prof, "stitch");
+    for (size_t n : nodes) module.ast_nodes += n;
+    stitchChunks(irs, module);
+    return true;
+}
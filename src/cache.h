@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "split.h"
+#include "stats.h"
+
+class WorkStealingPool;
+
+// Where compileCached finds the chunks compiled before and keeps the ones it
+// compiles. store() may be called from several threads at once.
+class ChunkStore {
+public:
+    virtual ~ChunkStore() = default;
+    virtual bool load(uint64_t key, ChunkIr& chunk) = 0;
+    virtual void store(uint64_t key, const ChunkIr& chunk) = 0;
+};
+
+// On-disk store of compiled chunks (voltage --cache <dir>), one file per
+// key. An entry is written to a temporary file and renamed into place, so
+// several threads or processes can share a directory; an entry that cannot
+// be read counts as a miss. Recency is the file's modification time, which
+// a hit refreshes.
+class IrCache : public ChunkStore {
+    std::string dir;
+    std::atomic<uint64_t> hit_count{0}, miss_count{0};
+    std::string path(uint64_t key) const;
+public:
+    struct Usage {
+        size_t entries = 0;
+        uint64_t bytes = 0;
+        size_t evicted = 0;
+    };
+
+    // Creates the directory if needed; throws std::runtime_error on failure.
+    explicit IrCache(std::string directory);
+    const std::string& directory() const { return dir; }
+    bool load(uint64_t key, ChunkIr& chunk) override;
+    // Errors are ignored: the chunk is simply compiled again next time.
+    void store(uint64_t key, const ChunkIr& chunk) override;
+    // Removes the least recently used entries until at most `limit` bytes
+    // remain, and reports what is left.
+    Usage trim(uint64_t limit) const;
+    uint64_t hits() const { return hit_count; }
+    uint64_t misses() const { return miss_count; }
+};
+
+// Compiles `source` in chunks, taking the ones compiled before from
+// `cache`. Chunk boundaries depend only on the statements themselves: a chunk
+// ends after a top-level statement whose token hash has a given residue, so
+// an edit moves at most the boundaries around it. A chunk's key hashes its
+// statements' tokens (not their layout), the types of the earlier top-level
+// variables it refers to and the code generation options. Changing a
+// statement thus recompiles its own chunk, and changing a variable's type
+// also recompiles the chunks that use it; values only flow through the
+// stitch-time phis, so nothing else depends on them.
+//
+// Misses are compiled on `pool` when one is given. Returns false when the
+// source does not lex or a recompiled chunk has an error; the caller then
+// compiles it sequentially, for the diagnostics.
+bool compileCached(std::string_view source, ChunkStore& cache, bool fold, const CodeGenOptions& gen,
+                   WorkStealingPool* pool,
+                   Profiler& prof, SplitModule& module, size_t& hits, size_t& misses);
@@ -0,0 +1,1043 @@
+#include "codegen.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include "fold.h"
+
+namespace {
+
+// Operand text of a CONST or NUMBER node; integers are written as signed
+// numbers of their width, and LLVM takes float and double immediates as
+// the hex bits of a double.
+std::string_view immediate(const Ast& ast, uint32_t n, char (&buf)[24]) {
+    Node c = ast[n].kind == NodeKind::NUMBER ? literalConst(ast, ast[n]) : ast[n];
+    if (!isFloatType(c.type)) {
+        unsigned shift = 64 - intBits(c.type); // an unsigned value's bits, read as signed
+        int64_t v = static_cast<int64_t>(constBits(c) << shift) >> shift;
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        return std::string_view(buf, static_cast<size_t>(r.ptr - buf));
+    }
+    double d = c.type == VoltType::FLOAT ? constFloat(c) : constDouble(c);
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    int len = std::snprintf(buf, sizeof(buf), "0x%016llX", static_cast<unsigned long long>(bits));
+    return std::string_view(buf, static_cast<size_t>(len));
+}
+
+bool isImmediate(const Node& n) { return n.kind == NodeKind::CONST || n.kind == NodeKind::NUMBER; }
+
+// Operand text of an ARRAY or SPLAT node as a vector constant. Elements of
+// a literal that are not constants are poison, to be filled in by
+// insertelement.
+std::string vectorImmediate(const Ast& ast, uint32_t n) {
+    const Node& v = ast[n];
+    std::string type = voltTypeToLLVM(v.type);
+    std::string text = "<";
+    char buf[24];
+    for (uint32_t i = 0; i < v.flags; ++i) {
+        uint32_t e = v.kind == NodeKind::SPLAT ? v.a : ast.extra[v.a + i];
+        text += i ? ", " : "";
+        text += type;
+        text += ' ';
+        if (isImmediate(ast[e])) text += immediate(ast, e, buf);
+        else text += "poison";
+    }
+    return text + '>';
+}
+
+} // namespace
+
+const char* moduleHeader() {
+    return "; ModuleID = 'volt_module'\n"
+#if defined(__x86_64__) && defined(__linux__)
+           "target datalayout = \"e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128\"\n"
+           "target triple = \"x86_64-pc-linux-gnu\"\n"
+#elif defined(__aarch64__) && defined(__linux__)
+           "target datalayout = \"e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128\"\n"
+           "target triple = \"aarch64-unknown-linux-gnu\"\n"
+#endif
+        ;
+}
+
+uint64_t CodeGen::Expr::hash() const {
+    uint64_t h = (static_cast<uint64_t>(op) << 16 | static_cast<uint64_t>(ka) << 8 | kb) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ a) * 0xc2b2ae3d27d4eb4full;
+    h = (h ^ (h >> 29) ^ b) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 32);
+}
+
+// Immediates are compared by value, so two literals of the same constant
+// are the same operand; array constants are compared by node.
+CodeGen::Expr CodeGen::expr(ExprKind kind, uint32_t detail, VoltType t, uint8_t length, Value a, Value b,
+                            bool commutative) const {
+    auto operand = [&](Value v) -> uint64_t {
+        if (v.kind != Value::IMM) return v.id;
+        if (ast[v.id].flags) return uint64_t(1) << 63 | v.id;
+        Node c = ast[v.id].kind == NodeKind::NUMBER ? literalConst(ast, ast[v.id]) : ast[v.id];
+        return static_cast<uint64_t>(c.b) << 32 | c.a;
+    };
+    Expr e{kind << 24 | static_cast<uint32_t>(length) << 16 | detail << 8 | static_cast<uint32_t>(t), a.kind, b.kind,
+           operand(a), operand(b)};
+    if (commutative && std::make_pair(e.kb, e.b) < std::make_pair(e.ka, e.a)) {
+        std::swap(e.ka, e.kb);
+        std::swap(e.a, e.b);
+    }
+    return e;
+}
+
+// Value numbering: finds the result of an instruction already available
+// here, which saves `saved` instructions.
+bool CodeGen::reuse(const Expr& e, Value& v, uint32_t saved) {
+    if (!opts.cse || available.empty()) return false;
+    size_t mask = available_slots.size() - 1;
+    for (size_t h = e.hash() & mask; available_slots[h]; h = (h + 1) & mask) {
+        const Available& a = available[available_slots[h] - 1];
+        if (a.expr == e) {
+            v = a.value;
+            removed += saved;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CodeGen::remember(const Expr& e, Value v) {
+    if (!opts.cse) return;
+    if ((available.size() + 1) * 2 > available_slots.size()) {
+        // Re-inserted oldest first, which keeps the newest-first removal order safe.
+        available_slots.assign(available_slots.empty() ? 1024 : available_slots.size() * 2, 0);
+        size_t mask = available_slots.size() - 1;
+        for (uint32_t i = 0; i < available.size(); ++i) {
+            size_t h = available[i].expr.hash() & mask;
+            while (available_slots[h]) h = (h + 1) & mask;
+            available_slots[h] = i + 1;
+            available[i].slot = static_cast<uint32_t>(h);
+        }
+    }
+    size_t mask = available_slots.size() - 1;
+    size_t h = e.hash() & mask;
+    while (available_slots[h]) h = (h + 1) & mask;
+    available.push_back({e, v, static_cast<uint32_t>(h)});
+    available_slots[h] = static_cast<uint32_t>(available.size());
+}
+
+// Drops the results computed since `mark`, when leaving blocks that do not
+// dominate the code emitted next.
+void CodeGen::forget(size_t mark) {
+    for (size_t i = available.size(); i-- > mark;) available_slots[available[i].slot] = 0;
+    available.resize(mark);
+}
+
+IrWriter& CodeGen::put(Value v) {
+    switch (v.kind) {
+    case Value::TEMP:
+        return out << '%' << prefix << 't' << v.id;
+    case Value::VAR:
+        return out << '%' << ast.str(versions[v.id].first) << '.' << prefix << versions[v.id].second;
+    case Value::INHERITED:
+        inherited_used[v.id] = true;
+        return out << '%' << ast.str(v.id) << '.' << prefix << "in";
+    case Value::IMM:
+        break;
+    }
+    if (ast[v.id].flags) return out << vectorImmediate(ast, v.id);
+    char buf[24];
+    return out << immediate(ast, v.id, buf);
+}
+
+// put() into a string, for values that outlive the chunk.
+std::string CodeGen::valueText(Value v) {
+    switch (v.kind) {
+    case Value::TEMP:
+        return '%' + prefix + 't' + std::to_string(v.id);
+    case Value::VAR:
+        return '%' + std::string(ast.str(versions[v.id].first)) + '.' + prefix +
+               std::to_string(versions[v.id].second);
+    case Value::INHERITED:
+        inherited_used[v.id] = true;
+        return '%' + std::string(ast.str(v.id)) + '.' + prefix + "in";
+    case Value::IMM:
+        break;
+    }
+    if (ast[v.id].flags) return vectorImmediate(ast, v.id);
+    char buf[24];
+    return std::string(immediate(ast, v.id, buf));
+}
+
+// Starts an instruction line.
+IrWriter& CodeGen::inst() {
+    ++instructions;
+    return out << "  ";
+}
+
+IrWriter& CodeGen::putBlock(uint32_t l) {
+    if (l == 0) return out << '%' << entry;
+    return out << '%' << labels[l] << '.' << prefix << l;
+}
+
+std::string CodeGen::blockText(uint32_t l) const {
+    if (l == 0) return entry;
+    return labels[l] + ('.' + prefix) + std::to_string(l);
+}
+
+uint32_t CodeGen::newLabel(const char* prefix) {
+    labels.push_back(prefix);
+    return static_cast<uint32_t>(labels.size() - 1);
+}
+
+void CodeGen::startBlock(uint32_t l) {
+    out << labels[l] << '.' << prefix << l << ':';
+    out.endLine();
+    block = l;
+}
+
+void CodeGen::jump(uint32_t l) {
+    inst() << "br label ";
+    putBlock(l);
+    out.endLine();
+    edge(l);
+}
+
+void CodeGen::condBr(Value c, uint32_t if_true, uint32_t if_false) {
+    inst() << "br i1 ";
+    put(c) << ", label ";
+    putBlock(if_true) << ", label ";
+    putBlock(if_false);
+    out.endLine();
+    edge(if_true);
+    edge(if_false);
+}
+
+// Next SSA version of a variable, printed as %name.N.
+Value CodeGen::newVersion(uint32_t name) {
+    versions.push_back({name, next_version[name]++});
+    return {Value::VAR, static_cast<uint32_t>(versions.size() - 1)};
+}
+
+// The value computed for node n; named after the variable when n is the
+// root of a declaration's value.
+Value CodeGen::result(uint32_t n) {
+    if (n != decl_value) return temp();
+    decl_value = NO_NODE;
+    return newVersion(decl_name);
+}
+
+void CodeGen::bind(uint32_t name, Binding b) {
+    Binding& cur = vars[name];
+    trail.push_back({name, cur});
+    cur = b;
+}
+
+// Undoes the bindings made since `mark` and returns the final values of
+// the variables that existed before it. Variables first declared after the
+// mark are local to the branch and disappear.
+std::vector<std::pair<uint32_t, CodeGen::Binding>> CodeGen::leaveScope(size_t mark) {
+    std::vector<std::pair<uint32_t, Binding>> mods;
+    std::unordered_set<uint32_t> seen;
+    for (size_t i = mark; i < trail.size(); ++i) {
+        uint32_t name = trail[i].first;
+        if (seen.insert(name).second && trail[i].second.bound) mods.push_back({name, vars[name]});
+    }
+    for (size_t i = trail.size(); i-- > mark;) vars[trail[i].first] = trail[i].second;
+    trail.resize(mark);
+    return mods;
+}
+
+void CodeGen::branchBody(const IfBranch& br) {
+    for (uint32_t k = 0; k < br.count; ++k) emit(ast.stmt(br, k));
+}
+
+// Starts the join block of an if and gives every variable assigned in one
+// of its branches a phi over all incoming edges. Edges that do not come
+// from a branch body (a false condition) carry the value from before the if.
+void CodeGen::join(uint32_t end, const std::vector<Exit>& exits) {
+    std::vector<uint32_t> in = std::move(preds[end]);
+    preds.erase(end);
+    startBlock(end);
+    std::unordered_map<uint32_t, const Exit*> by_block;
+    std::vector<uint32_t> names;
+    std::unordered_set<uint32_t> seen;
+    for (const Exit& e : exits) {
+        by_block.emplace(e.block, &e);
+        for (const auto& m : e.mods)
+            if (seen.insert(m.first).second) names.push_back(m.first);
+    }
+    std::vector<Value> incoming(in.size());
+    for (uint32_t name : names) {
+        Binding before = vars[name];
+        bool same = true;
+        for (size_t k = 0; k < in.size(); ++k) {
+            incoming[k] = before.value;
+            auto it = by_block.find(in[k]);
+            if (it != by_block.end())
+                for (const auto& m : it->second->mods)
+                    if (m.first == name) incoming[k] = m.second.value;
+            same = same && incoming[k].kind == incoming[0].kind && incoming[k].id == incoming[0].id;
+        }
+        if (same) {
+            bind(name, {incoming[0], before.type, before.length, true});
+            continue;
+        }
+        Value phi = newVersion(name);
+        inst();
+        put(phi) << " = phi " << voltTypeToLLVM(before.type, before.length) << ' ';
+        for (size_t k = 0; k < in.size(); ++k) {
+            out << (k ? ", [ " : "[ ");
+            put(incoming[k]) << ", ";
+            putBlock(in[k]) << " ]";
+        }
+        out.endLine();
+        bind(name, {phi, before.type, before.length, true});
+    }
+}
+
+void CodeGen::emitFunction() {
+    vars.assign(ast.strings.size(), Binding{{Value::TEMP, 0}, VoltType::INT, 0, false});
+    next_version.assign(ast.strings.size(), 0);
+    out << "define i32 @main() nounwind norecurse {";
+    out.endLine();
+    out << "entry:";
+    out.endLine();
+    for (uint32_t root : ast.roots) emit(root);
+    inst() << "ret i32 0";
+    out.endLine();
+    out << "}";
+    out.endLine();
+}
+
+void CodeGen::emitChunk(const std::string& name, const std::vector<Inherited>& inherited) {
+    vars.assign(ast.strings.size(), Binding{{Value::TEMP, 0}, VoltType::INT, 0, false});
+    next_version.assign(ast.strings.size(), 0);
+    prefix = name + '.';
+    entry = name;
+    inherited_used.assign(ast.strings.size(), false);
+    for (const Inherited& in : inherited) vars[in.sym] = {{Value::INHERITED, in.sym}, in.type, in.length, true};
+    for (uint32_t root : ast.roots) emit(root);
+    // Top-level values the following chunks start from. Reading an
+    // inherited value here counts as a use, so this comes before `used`.
+    for (uint32_t sym = 0; sym < vars.size(); ++sym) {
+        const Binding& b = vars[sym];
+        if (!b.bound || (b.value.kind == Value::INHERITED && b.value.id == sym)) continue;
+        exported.push_back({sym, b.type, b.length, valueText(b.value)});
+    }
+    for (const Inherited& in : inherited)
+        if (inherited_used[in.sym]) used.push_back(in);
+}
+
+// i1 test of a value against zero in its own type.
+Value CodeGen::testNonZero(uint32_t n, Value v) {
+    VoltType t = ast[n].type;
+    Expr e = expr(NONZERO, 0, t, 0, v, {Value::TEMP, 0});
+    Value res;
+    if (reuse(e, res)) return res;
+    res = temp();
+    inst();
+    put(res);
+    if (!isFloatType(t)) {
+        out << " = icmp ne " << voltTypeToLLVM(t) << ' ';
+        put(v) << ", 0";
+    } else {
+        out << " = fcmp " << (opts.fast_math ? "fast une " : "une ") << voltTypeToLLVM(t) << ' ';
+        put(v) << ", 0.0";
+    }
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+// i1 result of a gt/lt/gte/lte/di comparison (a vector of i1 for arrays).
+// Float predicates are ordered except 'di', which like C's != is true when
+// either side is NaN.
+Value CodeGen::compare(const Node& node, Value l, Value r) {
+    static const char* const int_pred[] = {"sgt", "slt", "sge", "sle", "ne", "eq"};
+    static const char* const uint_pred[] = {"ugt", "ult", "uge", "ule", "ne", "eq"};
+    static const char* const float_pred[] = {"ogt", "olt", "oge", "ole", "une", "oeq"};
+    VoltType t = ast[node.a].type;
+    uint8_t length = ast[node.a].flags;
+    // Equality does not depend on the operand order, even for NaNs.
+    Expr e = expr(CMP, node.op, t, length, l, r, node.op == EQ || node.op == DI);
+    Value res;
+    if (reuse(e, res)) return res;
+    res = temp();
+    inst();
+    put(res);
+    if (!isFloatType(t))
+        out << " = icmp " << (isUnsignedType(t) ? uint_pred : int_pred)[node.op - GT] << ' ';
+    else
+        out << " = fcmp " << (opts.fast_math ? "fast " : "") << float_pred[node.op - GT] << ' ';
+    out << voltTypeToLLVM(t, length) << ' ';
+    put(l) << ", ";
+    put(r);
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+// Branches to if_true or if_false on the truth of cond, short-circuiting
+// && and || into separate blocks instead of materialising their values.
+// The operands of && / || are visited with an explicit stack: the left
+// one, then the block of the right one, then the right one, after which
+// the results of that block are forgotten.
+void CodeGen::branchOn(uint32_t cond, uint32_t if_true, uint32_t if_false) {
+    enum Step : uint8_t { TEST, RHS, FORGET };
+    struct Item {
+        Step step;
+        uint32_t cond, if_true, if_false; // RHS: if_true is the block to start
+    };
+    std::vector<Item> work{{TEST, cond, if_true, if_false}};
+    std::vector<size_t> marks;
+    while (!work.empty()) {
+        Item it = work.back();
+        work.pop_back();
+        if (it.step == RHS) {
+            marks.push_back(available.size());
+            startBlock(it.if_true);
+            continue;
+        }
+        if (it.step == FORGET) {
+            forget(marks.back());
+            marks.pop_back();
+            continue;
+        }
+        const Node& node = ast[it.cond];
+        if (node.kind == NodeKind::BINOP && (node.op == AND || node.op == OR)) {
+            uint32_t rhs = newLabel(node.op == AND ? "and.rhs" : "or.rhs");
+            work.push_back({FORGET, 0, 0, 0});
+            work.push_back({TEST, node.b, it.if_true, it.if_false});
+            work.push_back({RHS, 0, rhs, 0});
+            if (node.op == AND) work.push_back({TEST, node.a, rhs, it.if_false});
+            else work.push_back({TEST, node.a, it.if_true, rhs});
+            continue;
+        }
+        if (node.kind == NodeKind::CONST) {
+            jump(constTruthy(node) ? it.if_true : it.if_false);
+            continue;
+        }
+        condBr(value(it.cond, true), it.if_true, it.if_false);
+    }
+}
+
+// One step of an && / || wanted as an i1. The right operand gets its own
+// block and only runs when the left one does not decide the result; a phi
+// joins the two paths.
+void CodeGen::logical(Frame f) {
+    const Node& node = ast[f.n];
+    bool is_and = node.op == AND;
+    if (f.step == 0) {
+        f.a = newLabel(is_and ? "and.rhs" : "or.rhs");
+        f.b = newLabel(is_and ? "and.end" : "or.end");
+        f.step = 1;
+        frames.push_back(f);
+        frames.push_back({node.a, 0, true});
+        return;
+    }
+    if (f.step == 1) {
+        Value lbool = popResult();
+        f.from = block;
+        condBr(lbool, is_and ? f.a : f.b, is_and ? f.b : f.a);
+        f.mark = available.size();
+        startBlock(f.a);
+        f.step = 2;
+        frames.push_back(f);
+        frames.push_back({node.b, 0, true});
+        return;
+    }
+    Value rbool = popResult();
+    uint32_t rhs_end = block;
+    jump(f.b);
+    forget(f.mark);
+    startBlock(f.b);
+    Value res = temp();
+    inst();
+    put(res) << " = phi i1 [ " << (is_and ? "false" : "true") << ", ";
+    putBlock(f.from) << " ], [ ";
+    put(rbool) << ", ";
+    putBlock(rhs_end) << " ]";
+    out.endLine();
+    results.push_back(res);
+}
+
+// Matches `x == c` or `c == x` with x an int variable and c an int
+// constant; var is the VARIABLE node.
+bool CodeGen::caseOf(uint32_t cond, uint32_t& var, int32_t& value) const {
+    const Node& node = ast[cond];
+    if (node.kind != NodeKind::LOGICOP || node.op != EQ) return false;
+    uint32_t v = node.a, c = node.b;
+    if (ast[v].kind != NodeKind::VARIABLE) std::swap(v, c);
+    const Node& cn = ast[c];
+    if (ast[v].kind != NodeKind::VARIABLE || ast[v].type != VoltType::INT || cn.type != VoltType::INT) return false;
+    if (cn.kind == NodeKind::CONST) value = constInt(cn);
+    else if (cn.kind == NodeKind::NUMBER) value = constInt(literalConst(ast, cn));
+    else return false;
+    var = v;
+    return true;
+}
+
+// Number of consecutive branches from `first` that compare one variable
+// against constants, or 0 if the run is too short to beat a compare ladder.
+uint32_t CodeGen::caseRun(const Node& ifNode, uint32_t first) const {
+    uint32_t var0 = 0, var, count = 0;
+    int32_t value;
+    for (uint32_t i = first; i < ifNode.b; ++i, ++count) {
+        uint32_t cond = ast.branch(ifNode, i).cond;
+        if (cond == NO_NODE || !caseOf(cond, var, value)) break;
+        if (count == 0) var0 = var;
+        else if (ast[var].a != ast[var0].a) break;
+    }
+    return count >= SWITCH_MIN_CASES ? count : 0;
+}
+
+// Lowers `count` branches matched by caseRun. Dense case sets become an
+// LLVM switch (a jump table after instruction selection); sparse ones a
+// balanced tree of signed compares, so dispatch costs O(log n) compares.
+void CodeGen::switchOn(const Node& ifNode, uint32_t first, uint32_t count, uint32_t dflt, uint32_t end,
+                       std::vector<Exit>& exits) {
+    struct Case { int32_t value; uint32_t branch, label; };
+    std::vector<Case> cases;
+    uint32_t var = 0;
+    for (uint32_t i = first; i < first + count; ++i) {
+        int32_t value;
+        caseOf(ast.branch(ifNode, i).cond, var, value);
+        bool seen = false; // a repeated constant can never be reached
+        for (const Case& c : cases) seen = seen || c.value == value;
+        if (!seen) cases.push_back({value, i, newLabel("sw.case")});
+    }
+    Value x = emit(var);
+    std::vector<Case> sorted = cases;
+    std::sort(sorted.begin(), sorted.end(), [](const Case& l, const Case& r) { return l.value < r.value; });
+    int64_t range = static_cast<int64_t>(sorted.back().value) - sorted.front().value + 1;
+    if (range * 2 <= static_cast<int64_t>(sorted.size()) * 5) { // at least 40% of the range is covered
+        inst() << "switch i32 ";
+        put(x) << ", label ";
+        putBlock(dflt) << " [";
+        out.endLine();
+        for (const Case& c : sorted) {
+            out << "    i32 " << static_cast<int>(c.value) << ", label ";
+            putBlock(c.label);
+            out.endLine();
+        }
+        out << "  ]";
+        out.endLine();
+        edge(dflt);
+    } else {
+        // Explicit stack of [lo, hi) ranges and the block each one starts in.
+        struct Range { size_t lo, hi; uint32_t label; };
+        std::vector<Range> work{{0, sorted.size(), 0}};
+        while (!work.empty()) {
+            Range r = work.back();
+            work.pop_back();
+            if (r.label != 0) startBlock(r.label);
+            if (r.hi - r.lo <= SWITCH_LINEAR_CASES) {
+                for (size_t k = r.lo; k < r.hi; ++k) {
+                    uint32_t miss = k + 1 < r.hi ? newLabel("sw.next") : dflt;
+                    Value c = temp();
+                    inst();
+                    put(c) << " = icmp eq i32 ";
+                    put(x) << ", " << static_cast<int>(sorted[k].value);
+                    out.endLine();
+                    condBr(c, sorted[k].label, miss);
+                    if (k + 1 < r.hi) startBlock(miss);
+                }
+                continue;
+            }
+            size_t mid = (r.lo + r.hi) / 2;
+            uint32_t below = newLabel("sw.lt"), above = newLabel("sw.ge");
+            Value c = temp();
+            inst();
+            put(c) << " = icmp slt i32 ";
+            put(x) << ", " << static_cast<int>(sorted[mid].value);
+            out.endLine();
+            condBr(c, below, above);
+            work.push_back({mid, r.hi, above});
+            work.push_back({r.lo, mid, below});
+        }
+    }
+    for (const Case& c : cases) {
+        startBlock(c.label);
+        size_t mark = trail.size(), vn_mark = available.size();
+        branchBody(ast.branch(ifNode, c.branch));
+        exits.push_back({block, leaveScope(mark)});
+        forget(vn_mark);
+        jump(end);
+    }
+}
+
+void CodeGen::ifStatement(const Node& node) {
+    uint32_t end = 0; // no join block until some branch is conditional
+    std::vector<Exit> exits;
+    bool open = true; // the current block still has to branch to the join
+    // Results of the first condition dominate the join; those of the later
+    // conditions and of the bodies do not.
+    size_t vn_mark = SIZE_MAX;
+    for (uint32_t i = 0; i < node.b; ++i) {
+        IfBranch br = ast.branch(node, i);
+        uint32_t cond = br.cond;
+        if (cond != NO_NODE && ast[cond].kind == NodeKind::CONST) {
+            if (!constTruthy(ast[cond])) continue; // never taken
+            cond = NO_NODE;                        // always taken: later branches are dead
+        }
+        if (cond == NO_NODE) {
+            size_t mark = trail.size();
+            branchBody(br);
+            auto mods = leaveScope(mark);
+            if (end == 0) { // the whole statement is unconditional
+                for (const auto& m : mods) bind(m.first, m.second);
+                return;
+            }
+            exits.push_back({block, std::move(mods)});
+            jump(end);
+            open = false;
+            break;
+        }
+        if (end == 0) {
+            end = newLabel("endif");
+            preds[end];
+        }
+        // Without an else the last condition falls through to the join.
+        uint32_t run = opts.switches ? caseRun(node, i) : 0;
+        bool last = i + (run != 0 ? run : 1) == node.b;
+        uint32_t next = last ? end : newLabel("else");
+        if (run != 0) {
+            if (vn_mark == SIZE_MAX) vn_mark = available.size();
+            switchOn(node, i, run, next, end, exits);
+            i += run - 1;
+        } else {
+            uint32_t then = newLabel("then");
+            branchOn(cond, then, next);
+            if (vn_mark == SIZE_MAX) vn_mark = available.size();
+            startBlock(then);
+            size_t mark = trail.size(), body_mark = available.size();
+            branchBody(br);
+            exits.push_back({block, leaveScope(mark)});
+            forget(body_mark);
+            jump(end);
+        }
+        if (last) {
+            open = false;
+            break;
+        }
+        startBlock(next);
+    }
+    if (end == 0) return;
+    if (open) jump(end);
+    forget(vn_mark);
+    join(end, exits);
+}
+
+// One step of an array literal: a vector constant, with the elements that
+// are not constants emitted and inserted into it one at a time.
+void CodeGen::array(Frame f) {
+    const Node& node = ast[f.n];
+    if (f.step == 0) {
+        f.b = NO_NODE; // last element to insert
+        for (uint32_t i = 0; i < node.b; ++i)
+            if (!isImmediate(ast[ast.extra[node.a + i]])) f.b = i;
+        f.acc = {Value::IMM, f.n};
+        if (f.b == NO_NODE) {
+            results.push_back(f.acc);
+            return;
+        }
+        f.a = 0;
+    } else {
+        uint32_t i = f.a;
+        Value v = popResult();
+        Value res = i == f.b ? result(f.n) : temp();
+        inst();
+        put(res) << " = insertelement " << voltTypeToLLVM(node.type, node.flags) << ' ';
+        put(f.acc) << ", " << voltTypeToLLVM(node.type) << ' ';
+        put(v) << ", i32 " << i;
+        out.endLine();
+        f.acc = res;
+        if (i == f.b) {
+            results.push_back(res);
+            return;
+        }
+        f.a = i + 1;
+    }
+    while (isImmediate(ast[ast.extra[node.a + f.a]])) ++f.a;
+    f.step = 1;
+    frames.push_back(f);
+    frames.push_back({ast.extra[node.a + f.a], 0, false});
+}
+
+// A scalar repeated over an array: a vector constant, or the scalar
+// inserted into element 0 and broadcast by a shufflevector.
+Value CodeGen::splat(uint32_t n, Value v) {
+    const Node& node = ast[n];
+    if (isImmediate(ast[node.a])) return {Value::IMM, n};
+    Expr e = expr(BROADCAST, 0, node.type, node.flags, v, {Value::TEMP, 0});
+    Value res;
+    if (reuse(e, res, 2)) return res;
+    std::string type = voltTypeToLLVM(node.type, node.flags);
+    Value first = temp();
+    inst();
+    put(first) << " = insertelement " << type << " poison, " << voltTypeToLLVM(node.type) << ' ';
+    put(v) << ", i32 0";
+    out.endLine();
+    res = result(n);
+    inst();
+    put(res) << " = shufflevector " << type << ' ';
+    put(first) << ", " << type << " poison, <" << static_cast<uint32_t>(node.flags) << " x i32> zeroinitializer";
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+// An element of an array. The index wraps around the length as an unsigned
+// number: a constant index is reduced here, any other with a urem, so an
+// index never reads outside the vector.
+Value CodeGen::element(uint32_t n, Value vec, Value i) {
+    const Node& node = ast[n];
+    uint8_t length = ast[node.a].flags;
+    const Node& index = ast[node.b];
+    bool constant = isImmediate(index);
+    uint32_t k = 0;
+    Value wrapped{Value::TEMP, 0};
+    Value res;
+    if (constant) {
+        uint64_t bits = constBits(index.kind == NodeKind::NUMBER ? literalConst(ast, index) : index);
+        if (intBits(index.type) < 64) bits &= (uint64_t(1) << intBits(index.type)) - 1;
+        k = static_cast<uint32_t>(bits % length);
+        if (vec.kind == Value::IMM) { // of a vector constant: the element itself
+            const Node& c = ast[vec.id];
+            uint32_t e = c.kind == NodeKind::SPLAT ? c.a : ast.extra[c.a + k];
+            if (isImmediate(ast[e])) return {Value::IMM, e};
+        }
+    } else {
+        Expr w = expr(WRAP, 0, index.type, length, i, {Value::TEMP, 0});
+        if (!reuse(w, wrapped)) {
+            wrapped = temp();
+            inst();
+            put(wrapped) << " = urem " << voltTypeToLLVM(index.type) << ' ';
+            put(i) << ", " << static_cast<uint32_t>(length);
+            out.endLine();
+            remember(w, wrapped);
+        }
+    }
+    // A constant index is part of the opcode, k + 1 so that it differs from
+    // a wrapped one.
+    Expr e = expr(EXTRACT, constant ? k + 1 : 0, node.type, length, vec, wrapped);
+    if (reuse(e, res)) return res;
+    res = result(n);
+    inst();
+    put(res) << " = extractelement " << voltTypeToLLVM(node.type, length) << ' ';
+    put(vec) << ", " << (constant ? "i32" : voltTypeToLLVM(index.type)) << ' ';
+    if (constant) out << k;
+    else put(wrapped);
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+// Variables bound before a loop that its body assigns, nested statements
+// included; they get a phi in the loop header.
+std::vector<uint32_t> CodeGen::carriedBy(const IfBranch& body) const {
+    std::vector<uint32_t> names;
+    std::unordered_set<uint32_t> seen;
+    std::vector<IfBranch> work{body};
+    while (!work.empty()) {
+        IfBranch br = work.back();
+        work.pop_back();
+        for (uint32_t k = 0; k < br.count; ++k) {
+            const Node& s = ast[ast.stmt(br, k)];
+            if (s.kind == NodeKind::VAR_DECL && vars[s.a].bound && seen.insert(s.a).second) names.push_back(s.a);
+            else if (s.kind == NodeKind::IF)
+                for (uint32_t i = 0; i < s.b; ++i) work.push_back(ast.branch(s, i));
+            else if (s.kind == NodeKind::FOR)
+                work.push_back(ast.loop(s).body());
+        }
+    }
+    return names;
+}
+
+// for i from A until B: the bounds are computed once before the loop. The
+// header phis are written before the body is emitted, so the values coming
+// back from the latch get their names up front; the latch defines them
+// with one-input phis of the body's final values, and the loop variable's
+// as its final value + 1.
+void CodeGen::forLoop(const Node& node) {
+    struct Carried {
+        uint32_t name;
+        Binding entry;
+        Value phi, next;
+    };
+    ForLoop loop = ast.loop(node);
+    Value from = emit(loop.from);
+    Value until = emit(loop.until);
+    IfBranch body = loop.body();
+    std::vector<Carried> carried{{loop.var, {from, VoltType::INT, 0, true}, {}, {}}};
+    for (uint32_t name : carriedBy(body)) carried.push_back({name, vars[name], {}, {}});
+    uint32_t pre = block;
+    uint32_t head = newLabel("for"), start = newLabel("for.body"), latch = newLabel("for.latch");
+    uint32_t end = newLabel("for.end");
+    jump(head);
+    startBlock(head);
+    size_t mark = trail.size();
+    for (Carried& c : carried) {
+        c.phi = newVersion(c.name);
+        c.next = newVersion(c.name);
+        inst();
+        put(c.phi) << " = phi " << voltTypeToLLVM(c.entry.type, c.entry.length) << " [ ";
+        put(c.entry.value) << ", ";
+        putBlock(pre) << " ], [ ";
+        put(c.next) << ", ";
+        putBlock(latch) << " ]";
+        out.endLine();
+        bind(c.name, {c.phi, c.entry.type, c.entry.length, true});
+    }
+    Value more = temp();
+    inst();
+    put(more) << " = icmp slt i32 ";
+    put(carried[0].phi) << ", ";
+    put(until);
+    out.endLine();
+    condBr(more, start, end);
+    // Results of the body do not dominate the next iteration or the exit.
+    size_t vn_mark = available.size();
+    startBlock(start);
+    branchBody(body);
+    uint32_t last = block;
+    jump(latch);
+    startBlock(latch);
+    for (size_t k = 1; k < carried.size(); ++k) {
+        inst();
+        put(carried[k].next) << " = phi " << voltTypeToLLVM(carried[k].entry.type, carried[k].entry.length) << " [ ";
+        put(vars[carried[k].name].value) << ", ";
+        putBlock(last) << " ]";
+        out.endLine();
+    }
+    inst();
+    put(carried[0].next) << " = add i32 "; // no nsw: the body may assign the loop variable
+    put(vars[loop.var].value) << ", 1";
+    out.endLine();
+    jump(head);
+    forget(vn_mark);
+    leaveScope(mark);
+    startBlock(end);
+    for (size_t k = 1; k < carried.size(); ++k)
+        bind(carried[k].name, {carried[k].phi, carried[k].entry.type, carried[k].entry.length, true});
+}
+
+Value CodeGen::emit(uint32_t n) {
+    const Node& node = ast[n];
+    switch (node.kind) {
+    case NodeKind::VAR_DECL: {
+        // No storage: the variable now names the value of its expression.
+        decl_value = node.b;
+        decl_name = node.a;
+        Value v = value(node.b, false);
+        decl_value = NO_NODE;
+        bind(node.a, {v, node.type, node.flags, true});
+        return v;
+    }
+    case NodeKind::IF:
+        ifStatement(node);
+        return {Value::TEMP, 0};
+    case NodeKind::FOR:
+        forLoop(node);
+        return {Value::TEMP, 0};
+    default:
+        return value(n, false);
+    }
+}
+
+// Pushes the operands of f.n that have to be emitted before it, after f
+// itself moved to step 1; returns false when f is already at step 1 and
+// its operands are in `results`.
+bool CodeGen::operands(const Frame& f) {
+    if (f.step != 0) return false;
+    const Node& node = ast[f.n];
+    frames.push_back({f.n, 1, f.i1});
+    if (f.i1 && node.kind != NodeKind::LOGICOP) { // tested against zero
+        frames.push_back({f.n, 0, false});
+        return true;
+    }
+    switch (node.kind) {
+    case NodeKind::BINOP:
+    case NodeKind::LOGICOP:
+        frames.push_back({node.b, 0, false});
+        frames.push_back({node.a, 0, false});
+        break;
+    case NodeKind::INDEX:
+        // A constant index is never emitted, see element().
+        if (!isImmediate(ast[node.b])) frames.push_back({node.b, 0, false});
+        frames.push_back({node.a, 0, false});
+        break;
+    case NodeKind::SPLAT:
+        if (!isImmediate(ast[node.a])) frames.push_back({node.a, 0, false});
+        break;
+    default: // CONVERT
+        frames.push_back({node.a, 0, false});
+    }
+    return true;
+}
+
+// Emits the instructions computing expression `root` and returns its value,
+// or with i1 its truth as an i1: comparisons and nested && / || are used as
+// they are rather than widened and retested. Post-order walk with an
+// explicit stack, like Sema::expr, so long operator chains cannot overflow
+// the native stack; each frame runs one step of its node, and the values
+// of its operands are on `results`.
+Value CodeGen::value(uint32_t root, bool i1) {
+    size_t base = frames.size();
+    frames.push_back({root, 0, i1});
+    while (frames.size() > base) {
+        Frame f = frames.back();
+        frames.pop_back();
+        const Node& node = ast[f.n];
+        bool logic = node.kind == NodeKind::BINOP && (node.op == AND || node.op == OR);
+        if (f.i1) {
+            if (logic) {
+                logical(f);
+            } else if (!operands(f)) {
+                Value r = popResult();
+                results.push_back(node.kind == NodeKind::LOGICOP ? compare(node, popResult(), r)
+                                                                 : testNonZero(f.n, r));
+            }
+            continue;
+        }
+        switch (node.kind) {
+        case NodeKind::NUMBER: // unfolded literal, printed as an immediate
+        case NodeKind::CONST:
+            results.push_back({Value::IMM, f.n});
+            break;
+        case NodeKind::VARIABLE:
+            results.push_back(vars[node.a].value);
+            break;
+        case NodeKind::BINOP:
+            if (logic) { // AND/OR logico (&&, ||)
+                if (f.step == 0) {
+                    frames.push_back({f.n, 1, false});
+                    frames.push_back({f.n, 0, true});
+                } else {
+                    results.push_back(widen(f.n, popResult()));
+                }
+            } else if (!operands(f)) {
+                Value r = popResult();
+                results.push_back(arith(f.n, popResult(), r));
+            }
+            break;
+        case NodeKind::LOGICOP:
+            if (!operands(f)) {
+                Value r = popResult();
+                results.push_back(widen(f.n, compare(node, popResult(), r)));
+            }
+            break;
+        case NodeKind::CONVERT:
+            if (!operands(f)) results.push_back(convert(f.n, popResult()));
+            break;
+        case NodeKind::SPLAT:
+            if (!operands(f)) results.push_back(splat(f.n, isImmediate(ast[node.a]) ? Value{Value::TEMP, 0} : popResult()));
+            break;
+        case NodeKind::INDEX:
+            if (!operands(f)) {
+                Value i = isImmediate(ast[node.b]) ? Value{Value::TEMP, 0} : popResult();
+                results.push_back(element(f.n, popResult(), i));
+            }
+            break;
+        case NodeKind::ARRAY:
+            array(f);
+            break;
+        case NodeKind::VAR_DECL:
+        case NodeKind::IF:
+        case NodeKind::FOR:
+            // Only reached through emit().
+            results.push_back(temp());
+            break;
+        }
+    }
+    return popResult();
+}
+
+Value CodeGen::arith(uint32_t n, Value lvar, Value rvar) {
+    const Node& node = ast[n];
+    // Floating point or integer operation
+    bool isFloat = isFloatType(node.type);
+    bool isUnsigned = isUnsignedType(node.type);
+    const char* opstr;
+    switch (node.op) {
+    case PLUS: opstr = isFloat ? "fadd" : "add"; break;
+    case MINUS: opstr = isFloat ? "fsub" : "sub"; break;
+    case MUL: opstr = isFloat ? "fmul" : "mul"; break;
+    case DIV: opstr = isFloat ? "fdiv" : isUnsigned ? "udiv" : "sdiv"; break;
+    case MOD: opstr = isFloat ? "frem" : isUnsigned ? "urem" : "srem"; break;
+    case SHL: opstr = "shl"; break;
+    default: opstr = isFloat ? "fadd" : "add";
+    }
+    // Signed overflow is undefined and unsigned arithmetic wraps. An
+    // operation on two immediates (such as variables bound to constants)
+    // is left unflagged, so it keeps the wrapped value the VM computes
+    // instead of becoming poison.
+    const char* flags = "";
+    if (isFloat && opts.fast_math) flags = " fast";
+    else if (!isFloat && !isUnsigned && node.op != DIV && node.op != MOD &&
+             !(lvar.kind == Value::IMM && rvar.kind == Value::IMM))
+        flags = " nsw";
+    // Float add and mul only commute up to the NaN payload they return.
+    bool commutative = (node.op == PLUS || node.op == MUL) && (!isFloat || opts.fast_math);
+    Expr e = expr(ARITH, node.op, node.type, node.flags, lvar, rvar, commutative);
+    Value res;
+    if (reuse(e, res)) return res;
+    res = result(n);
+    inst();
+    put(res) << " = " << opstr << flags << ' ' << voltTypeToLLVM(node.type, node.flags) << ' ';
+    put(lvar) << ", ";
+    put(rvar);
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+// The int (or int array) 0 / 1 value of an i1 result: of a comparison, or
+// of an && / || (which is never value-numbered, as its phi is in a block of
+// its own).
+Value CodeGen::widen(uint32_t n, Value cmp) {
+    const Node& node = ast[n];
+    if (node.kind == NodeKind::BINOP) {
+        Value res = result(n);
+        inst();
+        put(res) << " = zext i1 ";
+        put(cmp) << " to i32";
+        out.endLine();
+        return res;
+    }
+    Expr e = expr(ZEXT, 0, VoltType::INT, node.flags, cmp, {Value::TEMP, 0});
+    Value res;
+    if (reuse(e, res)) return res;
+    res = result(n);
+    inst();
+    if (node.flags == 0) {
+        put(res) << " = zext i1 ";
+        put(cmp) << " to i32";
+    } else {
+        std::string length = std::to_string(node.flags);
+        put(res) << " = zext <" << length << " x i1> ";
+        put(cmp) << " to <" << length << " x i32>";
+    }
+    out.endLine();
+    remember(e, res);
+    return res;
+}
+
+Value CodeGen::convert(uint32_t n, Value operand) {
+    const Node& node = ast[n];
+    VoltType from = ast[node.a].type;
+    // Between integers of one width only the signedness changes.
+    if (!isFloatType(from) && !isFloatType(node.type) && intBits(from) == intBits(node.type)) return operand;
+    Expr e = expr(CONV, static_cast<uint32_t>(from), node.type, node.flags, operand, {Value::TEMP, 0});
+    Value res;
+    if (reuse(e, res)) return res;
+    const char* opstr;
+    if (from == VoltType::FLOAT) opstr = " = fpext ";
+    else if (isFloatType(node.type)) opstr = isUnsignedType(from) ? " = uitofp " : " = sitofp ";
+    else opstr = isUnsignedType(from) ? " = zext " : " = sext ";
+    res = result(n);
+    inst();
+    put(res) << opstr << voltTypeToLLVM(from, node.flags) << ' ';
+    put(operand) << " to " << voltTypeToLLVM(node.type, node.flags);
+    out.endLine();
+    remember(e, res);
+    return res;
+}
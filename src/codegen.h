@@ -0,0 +1,231 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "irwriter.h"
+#include "parser.h"
+
+// An emitted value: a numbered temporary (%tN), a version of a variable
+// (%name.N), an immediate operand taken from a CONST or NUMBER node (or an
+// ARRAY or SPLAT node of constants), or the value a variable had when the
+// chunk started (%name.in, see emitChunk).
+struct Value {
+    enum Kind : uint8_t { TEMP, VAR, IMM, INHERITED } kind;
+    uint32_t id; // temporary number, index of the variable version, literal node or symbol
+};
+
+// Code generation options (voltage --no-switch, --no-cse, --fast-math).
+struct CodeGenOptions {
+    bool switches = true;   // elseif chains on one variable as switch / decision tree
+    bool cse = true;        // value numbering, see CodeGen::reuse
+    bool fast_math = false; // float ops carry the `fast` flag; add and mul are commutative
+};
+
+// Lines that start every module: its ID and, when the compiler was built
+// for a target it knows, that target's datalayout and triple, so that opt
+// and llc see the host's type sizes and alignments.
+const char* moduleHeader();
+
+// Lowers a type-checked flat AST (see Sema) to LLVM IR in SSA form by
+// switching on the node kind. Types are read from Node::type and never
+// re-derived; every instruction is appended straight to the IrWriter.
+//
+// Variables have no storage: a declaration binds the name to the value of
+// its expression, and the value computed for it is named %name.N. At the
+// join of an if, every variable assigned in a branch gets a phi. Temporaries
+// and versions are numbered in emission order, so the output only depends
+// on the input.
+//
+// Signed integer +, - and * carry `nsw`, since signed overflow is
+// undefined; unsigned arithmetic wraps and gets no flag. With fast_math,
+// float operations and comparisons carry `fast`.
+//
+// Arrays are SSA values too, of LLVM vector type: operators apply element
+// by element as single vector instructions, and indexing extracts an
+// element. A for loop is a header block with a phi for the loop variable
+// and for every outer variable its body assigns, the body, and a latch that
+// increments the loop variable and branches back.
+//
+// Control flow is lowered to basic blocks: each if/elseif/else branch gets
+// its own labelled block, conditions branch directly on icmp/fcmp results,
+// and && / || only evaluate their right operand when it decides the result.
+// Branches whose condition folded to a constant are not emitted at all.
+// Runs of elseif branches testing one int variable for equality with
+// constants are dispatched through a switch or a binary decision tree.
+//
+// Arithmetic, comparisons and conversions are value-numbered: one whose
+// opcode, type and operand values match an instruction in a dominating
+// block reuses that result instead of being emitted again.
+//
+// A module can also be emitted as a sequence of chunks of top-level
+// statements, each by its own CodeGen (voltage --split and --cache, see
+// split.h).
+class CodeGen {
+public:
+    // A top-level variable declared in an earlier chunk.
+    struct Inherited {
+        uint32_t sym;
+        VoltType type;
+        uint8_t length;
+    };
+    // Value of a top-level variable at the end of a chunk, as operand text.
+    struct Export {
+        uint32_t sym;
+        VoltType type;
+        uint8_t length;
+        std::string value;
+    };
+
+private:
+    static constexpr uint32_t SWITCH_MIN_CASES = 3;
+    static constexpr size_t SWITCH_LINEAR_CASES = 3; // tree leaves compared in sequence
+
+    struct Binding {
+        Value value;
+        VoltType type;
+        uint8_t length; // of an array, 0 for a scalar
+        bool bound;
+    };
+    // An instruction as value numbering sees it: opcode and type (with the
+    // array length) in op, and each operand as its Value kind and id, or an
+    // immediate's bits (the node id of an array constant).
+    struct Expr {
+        uint32_t op;
+        uint8_t ka, kb;
+        uint64_t a, b;
+        bool operator==(const Expr& e) const { return op == e.op && ka == e.ka && kb == e.kb && a == e.a && b == e.b; }
+        uint64_t hash() const;
+    };
+    struct Available {
+        Expr expr;
+        Value value;
+        uint32_t slot;
+    };
+    enum ExprKind : uint32_t { ARITH = 1, CMP, ZEXT, CONV, NONZERO, BROADCAST, WRAP, EXTRACT };
+    // Block that leaves a branch body, with the final values of the outer
+    // variables the branch assigned.
+    struct Exit {
+        uint32_t block;
+        std::vector<std::pair<uint32_t, Binding>> mods;
+    };
+    // A node of the expression being emitted (see value), with the state
+    // kept between the steps of an && / || or an array literal.
+    struct Frame {
+        uint32_t n;
+        uint8_t step;               // operands emitted so far
+        bool i1;                    // wanted as an i1 truth value
+        uint32_t a = 0, b = 0;      // && / ||: right and end labels; array: element to insert, last one
+        uint32_t from = 0;          // && / ||: block the left operand ended in
+        size_t mark = 0;            // && / ||: value numbering mark of the right operand's block
+        Value acc{Value::TEMP, 0};  // array: vector built so far
+    };
+
+    const Ast& ast;
+    Context& ctx;
+    IrWriter& out;
+    CodeGenOptions opts;
+    std::vector<const char*> labels{"entry"}; // label id -> name prefix
+    uint32_t block = 0;                       // block being appended to
+    std::unordered_map<uint32_t, std::vector<uint32_t>> preds; // join label -> predecessor blocks
+
+    std::vector<Binding> vars;                              // symbol id -> current value
+    std::vector<std::pair<uint32_t, Binding>> trail;        // previous binding of each bind()
+    std::vector<std::pair<uint32_t, uint32_t>> versions;    // Value::VAR id -> name, version
+    std::vector<uint32_t> next_version;                     // symbol id -> versions emitted
+    uint32_t decl_value = NO_NODE; // value root of the declaration being emitted
+    uint32_t decl_name = 0;
+    uint32_t instructions = 0;
+    std::vector<Frame> frames;  // expression walk, see value()
+    std::vector<Value> results; // values of the operands emitted by it
+
+    // Results available in the current block: computed there or in a block
+    // that dominates it, in the order they were added, so that leaving
+    // blocks that do not dominate what follows drops the newest ones. They
+    // are found through a linear-probing table; since entries only go
+    // newest first, no other entry's probe sequence runs through a slot
+    // being cleared.
+    std::vector<Available> available;
+    std::vector<uint32_t> available_slots; // index in `available` + 1, 0 = empty
+    uint32_t removed = 0;
+
+    // Chunked emission: names are prefixed so chunks never clash, and
+    // block 0 is the chunk's own entry block.
+    std::string prefix;
+    std::string entry = "entry";
+    std::vector<bool> inherited_used; // symbol id -> %name.in was referenced
+    std::vector<Inherited> used;
+    std::vector<Export> exported;
+
+    Expr expr(ExprKind kind, uint32_t detail, VoltType t, uint8_t length, Value a, Value b,
+              bool commutative = false) const;
+    bool reuse(const Expr& e, Value& v, uint32_t saved = 1);
+    void remember(const Expr& e, Value v);
+    void forget(size_t mark);
+    Value temp() { return {Value::TEMP, static_cast<uint32_t>(++ctx.temp_index)}; }
+    Value newVersion(uint32_t name);
+    Value result(uint32_t n);
+    IrWriter& inst();
+    IrWriter& put(Value v);
+    std::string valueText(Value v);
+    IrWriter& putBlock(uint32_t l);
+    std::string blockText(uint32_t l) const;
+    uint32_t newLabel(const char* prefix);
+    void startBlock(uint32_t l);
+    void edge(uint32_t to) {
+        auto it = preds.find(to);
+        if (it != preds.end()) it->second.push_back(block);
+    }
+    void jump(uint32_t l);
+    void condBr(Value c, uint32_t if_true, uint32_t if_false);
+    void bind(uint32_t name, Binding b);
+    std::vector<std::pair<uint32_t, Binding>> leaveScope(size_t mark);
+    void branchBody(const IfBranch& br);
+    void join(uint32_t end, const std::vector<Exit>& exits);
+    Value value(uint32_t root, bool i1);
+    bool operands(const Frame& f);
+    Value popResult() {
+        Value v = results.back();
+        results.pop_back();
+        return v;
+    }
+    Value testNonZero(uint32_t n, Value v);
+    Value compare(const Node& node, Value l, Value r);
+    Value arith(uint32_t n, Value l, Value r);
+    Value widen(uint32_t n, Value cmp);
+    Value convert(uint32_t n, Value operand);
+    void logical(Frame f);
+    void branchOn(uint32_t cond, uint32_t if_true, uint32_t if_false);
+    bool caseOf(uint32_t cond, uint32_t& var, int32_t& value) const;
+    uint32_t caseRun(const Node& ifNode, uint32_t first) const;
+    void switchOn(const Node& ifNode, uint32_t first, uint32_t count, uint32_t dflt, uint32_t end,
+                  std::vector<Exit>& exits);
+    void ifStatement(const Node& node);
+    void array(Frame f);
+    Value splat(uint32_t n, Value v);
+    Value element(uint32_t n, Value vec, Value i);
+    std::vector<uint32_t> carriedBy(const IfBranch& body) const;
+    void forLoop(const Node& node);
+public:
+    CodeGen(const Ast& a, Context& c, IrWriter& w, const CodeGenOptions& options = {})
+        : ast(a), ctx(c), out(w), opts(options) {}
+    // Emits the module's statements as the body of @main.
+    void emitFunction();
+    // Emits the statements of one chunk of @main, without its entry label
+    // and terminator. The chunk starts in block `name`, and every name it
+    // defines starts with `name.`. Variables in `inherited` are visible
+    // from the start as %var.<name>.in, a phi the caller writes for each
+    // one in usedInherited().
+    void emitChunk(const std::string& name, const std::vector<Inherited>& inherited);
+    // After emitChunk: the block the chunk ends in (without '%'), the
+    // inherited variables it read, and the top-level variables it declared
+    // or assigned.
+    std::string lastBlock() const { return blockText(block); }
+    const std::vector<Inherited>& usedInherited() const { return used; }
+    const std::vector<Export>& exports() const { return exported; }
+    // Emits the instructions computing node n and returns its value.
+    Value emit(uint32_t n);
+    // Instructions emitted so far, phis and terminators included.
+    uint32_t instructionCount() const { return instructions; }
+    // Instructions value numbering left out.
+    uint32_t removedInstructions() const { return removed; }
+};
@@ -0,0 +1,305 @@
+#include "fold.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int32_t constInt(const Node& n) { return static_cast<int32_t>(n.a); }
+
+uint64_t constBits(const Node& n) {
+    if (intBits(n.type) == 64) return (static_cast<uint64_t>(n.b) << 32) | n.a;
+    if (isUnsignedType(n.type)) return n.a;
+    return static_cast<uint64_t>(static_cast<int64_t>(constInt(n)));
+}
+
+Node makeInteger(VoltType t, uint64_t v) {
+    unsigned bits = intBits(t);
+    if (bits < 64) {
+        uint64_t mask = (uint64_t(1) << bits) - 1;
+        v &= mask;
+        if (!isUnsignedType(t) && (v >> (bits - 1)) != 0) v |= ~mask;
+    }
+    return Node{NodeKind::CONST, 0, t, 0, static_cast<uint32_t>(v), bits == 64 ? static_cast<uint32_t>(v >> 32) : 0};
+}
+
+float constFloat(const Node& n) {
+    float f;
+    std::memcpy(&f, &n.a, sizeof(f));
+    return f;
+}
+
+double constDouble(const Node& n) {
+    uint64_t bits = (static_cast<uint64_t>(n.b) << 32) | n.a;
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+bool constTruthy(const Node& c) {
+    switch (c.type) {
+    case VoltType::FLOAT: return constFloat(c) != 0.0f;
+    case VoltType::DOUBLE: return constDouble(c) != 0.0;
+    default: return constBits(c) != 0;
+    }
+}
+
+namespace {
+
+Node makeInt(int32_t v) { return Node{NodeKind::CONST, 0, VoltType::INT, 0, static_cast<uint32_t>(v), 0}; }
+
+Node makeFloat(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return Node{NodeKind::CONST, 0, VoltType::FLOAT, 0, bits, 0};
+}
+
+Node makeDouble(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return Node{NodeKind::CONST, 0, VoltType::DOUBLE, 0, static_cast<uint32_t>(bits), static_cast<uint32_t>(bits >> 32)};
+}
+
+bool isConst(const Node& n) { return n.kind == NodeKind::CONST; }
+
+template <typename T>
+bool compare(TokenType op, T l, T r) {
+    switch (op) {
+    case GT: return l > r;
+    case LT: return l < r;
+    case GTE: return l >= r;
+    case LTE: return l <= r;
+    case DI: return l != r;
+    case EQ: return l == r;
+    default: return false;
+    }
+}
+
+template <typename T>
+bool arith(TokenType op, T l, T r, T& res) {
+    switch (op) {
+    case PLUS: res = l + r; return true;
+    case MINUS: res = l - r; return true;
+    case MUL: res = l * r; return true;
+    case DIV: res = l / r; return true;
+    case MOD: res = std::fmod(l, r); return true;
+    default: return false;
+    }
+}
+
+// Integer arithmetic on the operands extended to 64 bits; makeInteger
+// truncates the result, so it wraps like the generated instructions.
+// Division by zero and MIN / -1 of a signed type are left for run time.
+bool intArith(TokenType op, VoltType t, uint64_t l, uint64_t r, uint64_t& res) {
+    switch (op) {
+    case PLUS: res = l + r; return true;
+    case MINUS: res = l - r; return true;
+    case MUL: res = l * r; return true;
+    case SHL: res = l << (r & (intBits(t) - 1)); return true;
+    case DIV:
+    case MOD: {
+        if (r == 0) return false;
+        if (isUnsignedType(t)) {
+            res = op == DIV ? l / r : l % r;
+            return true;
+        }
+        int64_t sl = static_cast<int64_t>(l), sr = static_cast<int64_t>(r);
+        int64_t min = intBits(t) == 64 ? INT64_MIN : -(int64_t(1) << (intBits(t) - 1));
+        if (sl == min && sr == -1) return false;
+        res = static_cast<uint64_t>(op == DIV ? sl / sr : sl % sr);
+        return true;
+    }
+    default: return false;
+    }
+}
+
+int log2Exact(int64_t v) {
+    if (v <= 0 || (v & (v - 1)) != 0) return -1;
+    int k = 0;
+    while ((int64_t(1) << k) != v) ++k;
+    return k;
+}
+
+} // namespace
+
+Node literalConst(const Ast& ast, const Node& number) {
+    std::string text(ast.str(number.a));
+    if (number.type == VoltType::FLOAT)
+        return makeFloat(std::strtof(text.c_str(), nullptr));
+    if (number.type == VoltType::DOUBLE)
+        return makeDouble(std::strtod(text.c_str(), nullptr));
+    if (isUnsignedType(number.type))
+        return makeInteger(number.type, std::strtoull(text.c_str(), nullptr, 10));
+    return makeInteger(number.type, static_cast<uint64_t>(std::strtoll(text.c_str(), nullptr, 10)));
+}
+
+void Folder::run() {
+    for (uint32_t root : ast.roots) statement(root);
+}
+
+void Folder::statement(uint32_t n) {
+    switch (ast[n].kind) {
+    case NodeKind::VAR_DECL:
+        expr(ast[n].b);
+        break;
+    case NodeKind::IF: {
+        Node ifNode = ast[n];
+        for (uint32_t i = 0; i < ifNode.b; ++i) {
+            IfBranch br = ast.branch(ifNode, i);
+            if (br.cond != NO_NODE) expr(br.cond);
+            for (uint32_t k = 0; k < br.count; ++k) statement(ast.stmt(br, k));
+        }
+        break;
+    }
+    case NodeKind::FOR: {
+        ForLoop loop = ast.loop(ast[n]);
+        expr(loop.from);
+        expr(loop.until);
+        IfBranch body = loop.body();
+        for (uint32_t k = 0; k < body.count; ++k) statement(ast.stmt(body, k));
+        break;
+    }
+    default:
+        expr(n);
+    }
+}
+
+void Folder::expr(uint32_t root) {
+    stack.push_back({root, false});
+    while (!stack.empty()) {
+        auto [n, children_done] = stack.back();
+        stack.pop_back();
+        NodeKind kind = ast[n].kind;
+        if (!children_done) {
+            if (kind == NodeKind::BINOP || kind == NodeKind::LOGICOP || kind == NodeKind::INDEX) {
+                stack.push_back({n, true});
+                stack.push_back({ast[n].b, false});
+                stack.push_back({ast[n].a, false});
+                continue;
+            }
+            if (kind == NodeKind::CONVERT || kind == NodeKind::SPLAT) {
+                stack.push_back({n, true});
+                stack.push_back({ast[n].a, false});
+                continue;
+            }
+            if (kind == NodeKind::ARRAY) {
+                stack.push_back({n, true});
+                for (uint32_t i = ast[n].b; i-- > 0;) stack.push_back({ast.extra[ast[n].a + i], false});
+                continue;
+            }
+        }
+        fold(n);
+    }
+}
+
+void Folder::fold(uint32_t n) {
+    Node node = ast[n];
+    switch (node.kind) {
+    case NodeKind::NUMBER:
+        ast.nodes[n] = literalConst(ast, node);
+        break;
+    case NodeKind::CONVERT: {
+        const Node& c = ast[node.a];
+        if (!isConst(c)) break;
+        if (!isFloatType(node.type)) {
+            ast.nodes[n] = makeInteger(node.type, constBits(c)); // sign- or zero-extends by c's type
+        } else if (!isFloatType(c.type)) {
+            // Converted straight from 64 bits, so an i64 rounds once like sitofp.
+            uint64_t bits = constBits(c);
+            if (node.type == VoltType::FLOAT)
+                ast.nodes[n] = makeFloat(isUnsignedType(c.type) ? static_cast<float>(bits)
+                                                                : static_cast<float>(static_cast<int64_t>(bits)));
+            else
+                ast.nodes[n] = makeDouble(isUnsignedType(c.type) ? static_cast<double>(bits)
+                                                                 : static_cast<double>(static_cast<int64_t>(bits)));
+        } else {
+            ast.nodes[n] = makeDouble(c.type == VoltType::FLOAT ? constFloat(c) : constDouble(c));
+        }
+        ++folded;
+        break;
+    }
+    case NodeKind::LOGICOP: {
+        const Node& l = ast[node.a];
+        const Node& r = ast[node.b];
+        if (!isConst(l) || !isConst(r)) break;
+        TokenType op = static_cast<TokenType>(node.op);
+        bool res;
+        if (l.type == VoltType::FLOAT) res = compare(op, constFloat(l), constFloat(r));
+        else if (l.type == VoltType::DOUBLE) res = compare(op, constDouble(l), constDouble(r));
+        else if (isUnsignedType(l.type)) res = compare(op, constBits(l), constBits(r));
+        else res = compare(op, static_cast<int64_t>(constBits(l)), static_cast<int64_t>(constBits(r)));
+        ast.nodes[n] = makeInt(res);
+        ++folded;
+        break;
+    }
+    case NodeKind::BINOP: {
+        const Node l = ast[node.a];
+        const Node r = ast[node.b];
+        TokenType op = static_cast<TokenType>(node.op);
+        if (op == AND || op == OR) {
+            // Operands have no side effects, so a known left side decides alone.
+            if (isConst(l) && constTruthy(l) == (op == OR)) {
+                ast.nodes[n] = makeInt(op == OR);
+                ++folded;
+            } else if (isConst(l) && isConst(r)) {
+                ast.nodes[n] = makeInt(constTruthy(r));
+                ++folded;
+            }
+            break;
+        }
+        if (isConst(l) && isConst(r)) {
+            if (!isFloatType(node.type)) {
+                uint64_t res;
+                if (!intArith(op, node.type, constBits(l), constBits(r), res)) break;
+                ast.nodes[n] = makeInteger(node.type, res);
+            } else if (node.type == VoltType::FLOAT) {
+                float res;
+                if (!arith(op, constFloat(l), constFloat(r), res)) break;
+                ast.nodes[n] = makeFloat(res);
+            } else {
+                double res;
+                if (!arith(op, constDouble(l), constDouble(r), res)) break;
+                ast.nodes[n] = makeDouble(res);
+            }
+            ++folded;
+            break;
+        }
+        // Integer identities; float ones are not exact because of -0.0 and NaN.
+        if (isFloatType(node.type)) break;
+        if (isConst(r)) {
+            int64_t c = static_cast<int64_t>(constBits(r));
+            if (c == 0 && (op == PLUS || op == MINUS)) replaceWith(n, node.a);
+            else if (c == 1 && (op == MUL || op == DIV)) replaceWith(n, node.a);
+            else if (c == 0 && op == MUL) { ast.nodes[n] = makeInteger(node.type, 0); ++folded; }
+            else if (op == MUL && log2Exact(c) > 0) {
+                ast.nodes[node.b] = makeInteger(node.type, log2Exact(c));
+                ast.nodes[n].op = SHL;
+                ++folded;
+            }
+        } else if (isConst(l)) {
+            int64_t c = static_cast<int64_t>(constBits(l));
+            if (c == 0 && op == PLUS) replaceWith(n, node.b);
+            else if (c == 1 && op == MUL) replaceWith(n, node.b);
+            else if (c == 0 && op == MUL) { ast.nodes[n] = makeInteger(node.type, 0); ++folded; }
+            else if (op == MUL && log2Exact(c) > 0) {
+                ast.nodes[n].a = node.b;
+                ast.nodes[node.a] = makeInteger(node.type, log2Exact(c));
+                ast.nodes[n].b = node.a;
+                ast.nodes[n].op = SHL;
+                ++folded;
+            }
+        }
+        break;
+    }
+    // Arrays stay nodes: CONST holds one scalar. CodeGen emits a literal
+    // of constants, or a splatted constant, as one vector constant.
+    case NodeKind::VARIABLE:
+    case NodeKind::CONST:
+    case NodeKind::ARRAY:
+    case NodeKind::INDEX:
+    case NodeKind::SPLAT:
+    case NodeKind::VAR_DECL:
+    case NodeKind::IF:
+    case NodeKind::FOR:
+        break;
+    }
+}
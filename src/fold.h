@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "parser.h"
+
+// Constant folding and algebraic simplification, run between Sema and
+// CodeGen. Literals become CONST nodes that are emitted as immediate
+// operands; constant subtrees are evaluated at their own width with the
+// same promotions Sema inserted, and integer identities (x+0, x*1, x*0,
+// x*2^k -> x<<k) are applied in place.
+class Folder {
+    Ast& ast;
+    std::vector<std::pair<uint32_t, bool>> stack;
+    uint32_t folded = 0;
+
+    void statement(uint32_t n);
+    void expr(uint32_t root);
+    void fold(uint32_t n);
+    void replaceWith(uint32_t n, uint32_t child) { ast.nodes[n] = ast.nodes[child]; ++folded; }
+public:
+    explicit Folder(Ast& a) : ast(a) {}
+    void run();
+    uint32_t foldedNodes() const { return folded; }
+};
+
+// CONST node holding the value of a NUMBER literal.
+Node literalConst(const Ast& ast, const Node& number);
+
+// Accessors for CONST node payloads. An integer CONST of 32 bits or fewer
+// holds its value sign- or zero-extended to 32 bits in `a`; a 64-bit one
+// holds the low half in `a` and the high half in `b`.
+int32_t constInt(const Node& n);
+// Value of an integer CONST of any type, sign- or zero-extended to 64 bits.
+uint64_t constBits(const Node& n);
+// Integer CONST of type t holding v truncated to the type's width.
+Node makeInteger(VoltType t, uint64_t v);
+float constFloat(const Node& n);
+double constDouble(const Node& n);
+// Whether a CONST is non-zero in its own type, as && / || and if test it.
+bool constTruthy(const Node& n);
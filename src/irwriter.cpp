@@ -0,0 +1,75 @@
+#include "irwriter.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
+IrWriter::IrWriter(int f, size_t c) : fd(f), chunk(c) {
+    // The slack holds the end of a typical line after the buffer reaches
+    // `chunk`. A longer line (a 255-element vector constant, a phi with many
+    // predecessors) is written out mid-line by spill(), so the buffer is
+    // never reallocated.
+    buf.reserve(chunk + 4096);
+}
+
+void IrWriter::writeAll(const char* p, size_t left) {
+    while (left > 0) {
+        auto n = ::write(fd, p, static_cast<unsigned>(left));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+}
+
+void IrWriter::writeOut() {
+    writeAll(buf.data(), buf.size());
+    written += buf.size();
+    buf.clear();
+}
+
+// `s` does not fit in what is left of the buffer: writes out the buffer and
+// appends `s`, or writes `s` straight to the file if it would not fit even
+// in an empty buffer.
+IrWriter& IrWriter::spill(std::string_view s) {
+    writeOut();
+    if (s.size() > buf.capacity()) {
+        writeAll(s.data(), s.size());
+        written += s.size();
+    } else {
+        buf.append(s.data(), s.size());
+    }
+    return *this;
+}
+
+void IrWriter::write(std::string_view s) {
+    if (fd < 0 || s.size() < chunk) {
+        *this << s;
+        if (fd >= 0 && buf.size() >= chunk) writeOut();
+        return;
+    }
+    flush();
+    writeAll(s.data(), s.size());
+    written += s.size();
+}
+
+IrWriter& IrWriter::operator<<(uint32_t v) {
+    char tmp[16];
+    auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    return *this << std::string_view(tmp, static_cast<size_t>(res.ptr - tmp));
+}
+
+IrWriter& IrWriter::operator<<(int v) {
+    char tmp[16];
+    auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    return *this << std::string_view(tmp, static_cast<size_t>(res.ptr - tmp));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Append-only output buffer for generated IR. Text is appended in place and
+// written to the file descriptor whenever the buffer reaches `chunk` bytes,
+// so memory use stays bounded no matter how large the module gets.
+//
+// A default-constructed writer has no file and keeps everything in memory
+// until text() is taken (one chunk of a --split compile).
+class IrWriter {
+    std::string buf;
+    int fd;
+    size_t chunk;
+    size_t written = 0;
+    void writeAll(const char* p, size_t n);
+    void writeOut();
+    IrWriter& spill(std::string_view s);
+public:
+    IrWriter() : fd(-1), chunk(SIZE_MAX) {}
+    explicit IrWriter(int fd, size_t chunk = 1 << 16);
+    ~IrWriter() { try { flush(); } catch (...) {} }
+    IrWriter(const IrWriter&) = delete;
+    IrWriter& operator=(const IrWriter&) = delete;
+
+    IrWriter& operator<<(std::string_view s) {
+        if (buf.size() + s.size() > buf.capacity() && fd >= 0) return spill(s);
+        buf.append(s.data(), s.size());
+        return *this;
+    }
+    IrWriter& operator<<(const char* s) { return *this << std::string_view(s); }
+    IrWriter& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    IrWriter& operator<<(uint32_t v);
+    IrWriter& operator<<(int v);
+
+    // Called between instructions: writes the buffer out once it is full.
+    void endLine() {
+        buf.push_back('\n');
+        if (buf.size() >= chunk) writeOut();
+    }
+    void flush() { if (fd >= 0 && !buf.empty()) writeOut(); }
+    // Writes a block of finished text, such as another writer's text(),
+    // without copying it into the buffer.
+    void write(std::string_view s);
+    size_t bytesWritten() const { return written + buf.size(); }
+    // Moves the buffered text out of a writer without a file.
+    std::string takeText() { return std::move(buf); }
+};
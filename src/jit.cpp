@@ -0,0 +1,517 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define VOLT_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef VOLT_JIT_X64
+
+namespace {
+
+enum Reg64 { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum Xmm { XMM0, XMM1 };
+enum Cond { CC_E = 4, CC_NE = 5, CC_AE = 3, CC_A = 7, CC_P = 10, CC_NP = 11, CC_L = 12, CC_GE = 13, CC_LE = 14, CC_G = 15 };
+
+// Allocatable registers. RAX/RCX/RDX and XMM0/XMM1 are scratch, RDI holds
+// the VM register file and RSP addresses spill slots.
+const int GPR_POOL[] = {RSI, R8, R9, R10, R11, RBX, R12, R13, R14, R15};
+const int XMM_POOL[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+const int SAVED[] = {RBX, R12, R13, R14, R15};
+
+// Register or [base + disp32] operand.
+struct RM {
+    bool mem;
+    int reg; // register, or base register of a memory operand
+    int32_t disp;
+    static RM r(int reg) { return {false, reg, 0}; }
+    static RM m(int base, int32_t disp) { return {true, base, disp}; }
+};
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+    void byte(uint8_t b) { code.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs) { code.insert(code.end(), bs); }
+    void dword(uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+    size_t pos() const { return code.size(); }
+
+    // [prefixes] [REX] opcode ModRM [SIB] [disp32]
+    void op(std::initializer_list<uint8_t> prefix, bool w, std::initializer_list<uint8_t> opc, int reg, RM rm) {
+        for (uint8_t p : prefix) byte(p);
+        uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm.reg & 8) ? 1 : 0);
+        if (rex != 0x40) byte(rex);
+        for (uint8_t o : opc) byte(o);
+        if (!rm.mem) {
+            byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm.reg & 7)));
+            return;
+        }
+        byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (rm.reg & 7)));
+        if ((rm.reg & 7) == RSP) byte(0x24);
+        dword(static_cast<uint32_t>(rm.disp));
+    }
+
+    // Jumps return the position of their rel32 field for bind().
+    size_t jmp() { byte(0xE9); dword(0); return pos() - 4; }
+    size_t jcc(int cc) { bytes({0x0F, static_cast<uint8_t>(0x80 | cc)}); dword(0); return pos() - 4; }
+    void bind(size_t field, size_t target) {
+        int32_t rel = static_cast<int32_t>(target) - static_cast<int32_t>(field + 4);
+        std::memcpy(&code[field], &rel, 4);
+    }
+    void push(int r) { if (r & 8) byte(0x41); byte(static_cast<uint8_t>(0x50 | (r & 7))); }
+    void pop(int r) { if (r & 8) byte(0x41); byte(static_cast<uint8_t>(0x58 | (r & 7))); }
+};
+
+enum class Shape { BINARY, UNARY, MOV, BRANCH, JUMP, NONE };
+
+Shape shapeOf(Op op) {
+    switch (op) {
+    case Op::TEST_F32: case Op::TEST_F64: case Op::TEST_I32:
+    case Op::I32_TO_F32: case Op::I32_TO_F64: case Op::F32_TO_F64:
+        return Shape::UNARY;
+    case Op::MOV: return Shape::MOV;
+    case Op::JZ: case Op::JNZ: return Shape::BRANCH;
+    case Op::JMP: return Shape::JUMP;
+    case Op::HALT: case Op::COUNT: return Shape::NONE;
+    default: return Shape::BINARY;
+    }
+}
+
+bool floatResult(Op op) {
+    switch (op) {
+    case Op::ADD_F32: case Op::SUB_F32: case Op::MUL_F32: case Op::DIV_F32: case Op::MOD_F32:
+    case Op::ADD_F64: case Op::SUB_F64: case Op::MUL_F64: case Op::DIV_F64: case Op::MOD_F64:
+    case Op::I32_TO_F32: case Op::I32_TO_F64: case Op::F32_TO_F64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+struct Interval {
+    uint32_t temp, start, end;
+    bool xmm;
+};
+
+// Location of every temporary: a physical register (>= 0) or a spill slot
+// encoded as -(slot + 1).
+struct Allocation {
+    std::vector<int> loc;
+    std::vector<bool> xmm;
+    uint32_t slots = 0;
+};
+
+// Classic linear scan: intervals in start order, the active set sorted by
+// end, and the interval ending last is spilled when a register class runs out.
+Allocation linearScan(const Bytecode& bc) {
+    uint32_t fixed = bc.fixed_regs;
+    uint32_t temps = static_cast<uint32_t>(bc.initial.size()) - fixed;
+    std::vector<Interval> ivs;
+    std::vector<uint32_t> index(temps, UINT32_MAX);
+    auto touch = [&](uint32_t reg, uint32_t at, bool def, bool xmm) {
+        if (reg < fixed) return;
+        uint32_t t = reg - fixed;
+        if (index[t] == UINT32_MAX) {
+            index[t] = static_cast<uint32_t>(ivs.size());
+            ivs.push_back({t, at, at, def && xmm});
+        }
+        ivs[index[t]].end = at;
+    };
+    for (uint32_t i = 0; i < bc.code.size(); ++i) {
+        const Instr& in = bc.code[i];
+        switch (shapeOf(in.op)) {
+        case Shape::BINARY: touch(in.a, i, false, false); touch(in.b, i, false, false); touch(in.dst, i, true, floatResult(in.op)); break;
+        case Shape::UNARY: touch(in.a, i, false, false); touch(in.dst, i, true, floatResult(in.op)); break;
+        case Shape::MOV: touch(in.a, i, false, false); break;
+        case Shape::BRANCH: touch(in.a, i, false, false); break;
+        case Shape::JUMP: case Shape::NONE: break;
+        }
+    }
+
+    Allocation alloc;
+    alloc.loc.assign(temps, 0);
+    alloc.xmm.assign(temps, false);
+    std::vector<int> gpr_free(std::rbegin(GPR_POOL), std::rend(GPR_POOL));
+    std::vector<int> xmm_free(std::rbegin(XMM_POOL), std::rend(XMM_POOL));
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> active; // interval indices, sorted by end
+
+    auto release = [&](const Interval& iv) {
+        int l = alloc.loc[iv.temp];
+        if (l < 0) free_slots.push_back(static_cast<uint32_t>(-l - 1));
+        else (iv.xmm ? xmm_free : gpr_free).push_back(l);
+    };
+    auto newSlot = [&]() -> int {
+        uint32_t s;
+        if (!free_slots.empty()) { s = free_slots.back(); free_slots.pop_back(); }
+        else s = alloc.slots++;
+        return -static_cast<int>(s) - 1;
+    };
+
+    for (uint32_t k = 0; k < ivs.size(); ++k) {
+        const Interval& iv = ivs[k];
+        alloc.xmm[iv.temp] = iv.xmm;
+        while (!active.empty() && ivs[active.front()].end < iv.start) {
+            release(ivs[active.front()]);
+            active.erase(active.begin());
+        }
+        std::vector<int>& pool = iv.xmm ? xmm_free : gpr_free;
+        if (!pool.empty()) {
+            alloc.loc[iv.temp] = pool.back();
+            pool.pop_back();
+        } else {
+            // Spill whichever of the same class lives longest.
+            int victim = -1;
+            for (int j = static_cast<int>(active.size()) - 1; j >= 0; --j) {
+                const Interval& a = ivs[active[j]];
+                if (a.xmm == iv.xmm && alloc.loc[a.temp] >= 0) { victim = j; break; }
+            }
+            if (victim >= 0 && ivs[active[victim]].end > iv.end) {
+                const Interval& a = ivs[active[victim]];
+                alloc.loc[iv.temp] = alloc.loc[a.temp];
+                alloc.loc[a.temp] = newSlot();
+            } else {
+                alloc.loc[iv.temp] = newSlot();
+            }
+        }
+        auto pos = std::upper_bound(active.begin(), active.end(), iv.end,
+                                    [&](uint32_t end, uint32_t idx) { return end < ivs[idx].end; });
+        active.insert(pos, k);
+    }
+    return alloc;
+}
+
+class X64Lowering {
+    const Bytecode& bc;
+    Allocation alloc;
+    Assembler as;
+    int32_t frame = 0;
+    std::vector<size_t> labels;                           // native offset of each instruction
+    std::vector<std::pair<size_t, uint32_t>> fixups;      // rel32 field -> instruction index
+    std::vector<size_t> div_zero, mod_zero, halts;
+
+    static constexpr int32_t SCRATCH = 0;  // 16 bytes at [rsp] for x87 fmod
+    static constexpr int32_t SPILLS = 16;
+
+    RM at(uint32_t reg) const {
+        if (reg < bc.fixed_regs) return RM::m(RDI, static_cast<int32_t>(reg * sizeof(Reg)));
+        int l = alloc.loc[reg - bc.fixed_regs];
+        if (l >= 0) return RM::r(l);
+        return RM::m(RSP, SPILLS + 8 * (-l - 1));
+    }
+    bool inXmm(uint32_t reg) const { return reg >= bc.fixed_regs && alloc.xmm[reg - bc.fixed_regs]; }
+
+    // 32-bit integer moves and ALU ops.
+    void loadI(int r, RM src) { as.op({}, false, {0x8B}, r, src); }
+    void storeI(RM dst, int r) { as.op({}, false, {0x89}, r, dst); }
+    // Scalar SSE moves: prefix F3 = single, F2 = double.
+    void loadF(uint8_t pfx, int x, RM src) { as.op({pfx}, false, {0x0F, 0x10}, x, src); }
+    void storeF(uint8_t pfx, RM dst, int x) { as.op({pfx}, false, {0x0F, 0x11}, x, dst); }
+    void setcc(int cc) {
+        as.op({}, false, {0x0F, static_cast<uint8_t>(0x90 | cc)}, 0, RM::r(RAX));
+    }
+    void setccUnordered(int cc) { // al = cc || parity (unordered compares count as true)
+        setcc(cc);
+        as.op({}, false, {0x0F, 0x9A}, 0, RM::r(RCX));
+        as.op({}, false, {0x08}, RCX, RM::r(RAX)); // or al, cl
+    }
+    void setccOrdered(int cc) { // al = cc && !parity (unordered compares count as false)
+        setcc(cc);
+        as.op({}, false, {0x0F, 0x9B}, 0, RM::r(RCX));
+        as.op({}, false, {0x20}, RCX, RM::r(RAX)); // and al, cl
+    }
+    void storeBool(uint32_t dst) {
+        as.op({}, false, {0x0F, 0xB6}, RAX, RM::r(RAX)); // movzx eax, al
+        storeI(at(dst), RAX);
+    }
+
+    void prologue();
+    void epilogue();
+    void instr(const Instr& in);
+    void intArith(const Instr& in);
+    void divMod(const Instr& in);
+    void floatArith(const Instr& in, bool dbl);
+    void floatMod(const Instr& in, bool dbl);
+    void compare(const Instr& in);
+public:
+    explicit X64Lowering(const Bytecode& b) : bc(b), alloc(linearScan(b)) {}
+    std::vector<uint8_t> lower();
+};
+
+void X64Lowering::prologue() {
+    for (int r : SAVED) as.push(r);
+    frame = static_cast<int32_t>((SPILLS + 8 * alloc.slots + 15) & ~15u);
+    as.op({}, true, {0x81}, 5, RM::r(RSP)); // sub rsp, frame
+    as.dword(static_cast<uint32_t>(frame));
+}
+
+void X64Lowering::epilogue() {
+    size_t ok = as.pos();
+    as.op({}, false, {0x31}, RAX, RM::r(RAX)); // xor eax, eax
+    size_t to_exit = as.jmp();
+    size_t dz = as.pos();
+    as.byte(0xB8); as.dword(1);                // mov eax, 1
+    size_t dz_exit = as.jmp();
+    size_t mz = as.pos();
+    as.byte(0xB8); as.dword(2);                // mov eax, 2
+    size_t exit = as.pos();
+    as.op({}, true, {0x81}, 0, RM::r(RSP));    // add rsp, frame
+    as.dword(static_cast<uint32_t>(frame));
+    for (int k = static_cast<int>(sizeof(SAVED) / sizeof(SAVED[0])) - 1; k >= 0; --k) as.pop(SAVED[k]);
+    as.byte(0xC3);
+    as.bind(to_exit, exit);
+    as.bind(dz_exit, exit);
+    for (size_t f : halts) as.bind(f, ok);
+    for (size_t f : div_zero) as.bind(f, dz);
+    for (size_t f : mod_zero) as.bind(f, mz);
+}
+
+void X64Lowering::intArith(const Instr& in) {
+    loadI(RAX, at(in.a));
+    switch (in.op) {
+    case Op::ADD_I32: as.op({}, false, {0x03}, RAX, at(in.b)); break;
+    case Op::SUB_I32: as.op({}, false, {0x2B}, RAX, at(in.b)); break;
+    case Op::MUL_I32: as.op({}, false, {0x0F, 0xAF}, RAX, at(in.b)); break;
+    default: // SHL_I32
+        loadI(RCX, at(in.b));
+        as.op({}, false, {0xD3}, 4, RM::r(RAX)); // shl eax, cl
+    }
+    storeI(at(in.dst), RAX);
+}
+
+// idiv traps on a zero divisor and on INT_MIN / -1; the first is reported,
+// the second wraps like the VM (quotient INT_MIN, remainder 0).
+void X64Lowering::divMod(const Instr& in) {
+    bool div = in.op == Op::DIV_I32;
+    loadI(RCX, at(in.b));
+    as.op({}, false, {0x85}, RCX, RM::r(RCX));            // test ecx, ecx
+    (div ? div_zero : mod_zero).push_back(as.jcc(CC_E));
+    loadI(RAX, at(in.a));
+    as.op({}, false, {0x83}, 7, RM::r(RCX)); as.byte(0xFF); // cmp ecx, -1
+    size_t regular = as.jcc(CC_NE);
+    if (div) as.op({}, false, {0xF7}, 3, RM::r(RAX));       // neg eax
+    else as.op({}, false, {0x31}, RDX, RM::r(RDX));         // xor edx, edx
+    size_t done = as.jmp();
+    as.bind(regular, as.pos());
+    as.byte(0x99);                                           // cdq
+    as.op({}, false, {0xF7}, 7, RM::r(RCX));                 // idiv ecx
+    as.bind(done, as.pos());
+    storeI(at(in.dst), div ? RAX : RDX);
+}
+
+void X64Lowering::floatArith(const Instr& in, bool dbl) {
+    uint8_t pfx = dbl ? 0xF2 : 0xF3;
+    uint8_t opc;
+    switch (in.op) {
+    case Op::ADD_F32: case Op::ADD_F64: opc = 0x58; break;
+    case Op::SUB_F32: case Op::SUB_F64: opc = 0x5C; break;
+    case Op::MUL_F32: case Op::MUL_F64: opc = 0x59; break;
+    default: opc = 0x5E; // DIV
+    }
+    loadF(pfx, XMM0, at(in.a));
+    as.op({pfx}, false, {0x0F, opc}, XMM0, at(in.b));
+    storeF(pfx, at(in.dst), XMM0);
+}
+
+// fmod without a libm call: x87 fprem repeated until the reduction is
+// complete gives the exact remainder with the dividend's sign.
+void X64Lowering::floatMod(const Instr& in, bool dbl) {
+    uint8_t pfx = dbl ? 0xF2 : 0xF3;
+    uint8_t fop = dbl ? 0xDD : 0xD9;
+    RM x = RM::m(RSP, SCRATCH), y = RM::m(RSP, SCRATCH + 8);
+    loadF(pfx, XMM0, at(in.a));
+    storeF(pfx, x, XMM0);
+    loadF(pfx, XMM0, at(in.b));
+    storeF(pfx, y, XMM0);
+    as.op({}, false, {fop}, 0, y);          // fld divisor
+    as.op({}, false, {fop}, 0, x);          // fld dividend
+    size_t loop = as.pos();
+    as.bytes({0xD9, 0xF8});                 // fprem
+    as.bytes({0xDF, 0xE0});                 // fnstsw ax
+    as.bytes({0xF6, 0xC4, 0x04});           // test ah, 4 (C2: reduction incomplete)
+    as.byte(0x75);                          // jnz loop
+    as.byte(static_cast<uint8_t>(static_cast<int8_t>(loop - (as.pos() + 1))));
+    as.bytes({0xDD, 0xD9});                 // fstp st(1)
+    as.op({}, false, {fop}, 3, x);          // fstp result
+    loadF(pfx, XMM0, x);
+    storeF(pfx, at(in.dst), XMM0);
+}
+
+void X64Lowering::compare(const Instr& in) {
+    int kind = 0; // 0 = int, 1 = float, 2 = double
+    TokenType rel;
+    switch (in.op) {
+    case Op::GT_I32: rel = GT; break;
+    case Op::LT_I32: rel = LT; break;
+    case Op::GTE_I32: rel = GTE; break;
+    case Op::LTE_I32: rel = LTE; break;
+    case Op::NE_I32: rel = DI; break;
+    case Op::EQ_I32: rel = EQ; break;
+    case Op::GT_F32: kind = 1; rel = GT; break;
+    case Op::LT_F32: kind = 1; rel = LT; break;
+    case Op::GTE_F32: kind = 1; rel = GTE; break;
+    case Op::LTE_F32: kind = 1; rel = LTE; break;
+    case Op::NE_F32: kind = 1; rel = DI; break;
+    case Op::EQ_F32: kind = 1; rel = EQ; break;
+    case Op::GT_F64: kind = 2; rel = GT; break;
+    case Op::LT_F64: kind = 2; rel = LT; break;
+    case Op::GTE_F64: kind = 2; rel = GTE; break;
+    case Op::LTE_F64: kind = 2; rel = LTE; break;
+    case Op::NE_F64: kind = 2; rel = DI; break;
+    default: kind = 2; rel = EQ; break; // EQ_F64
+    }
+    if (kind == 0) {
+        loadI(RAX, at(in.a));
+        as.op({}, false, {0x3B}, RAX, at(in.b)); // cmp eax, b
+        setcc(rel == GT ? CC_G : rel == LT ? CC_L : rel == GTE ? CC_GE : rel == LTE ? CC_LE : rel == DI ? CC_NE : CC_E);
+        storeBool(in.dst);
+        return;
+    }
+    // ucomis sets CF for "below" and for unordered, so < and <= compare the
+    // swapped operands with "above" conditions and are false on NaN.
+    uint8_t pfx = kind == 1 ? 0xF3 : 0xF2;
+    bool swap = rel == LT || rel == LTE;
+    loadF(pfx, XMM0, at(swap ? in.b : in.a));
+    if (kind == 1) as.op({}, false, {0x0F, 0x2E}, XMM0, at(swap ? in.a : in.b));     // ucomiss
+    else as.op({0x66}, false, {0x0F, 0x2E}, XMM0, at(swap ? in.a : in.b));           // ucomisd
+    if (rel == DI) setccUnordered(CC_NE);
+    else if (rel == EQ) setccOrdered(CC_E);
+    else setcc(rel == GT || rel == LT ? CC_A : CC_AE);
+    storeBool(in.dst);
+}
+
+void X64Lowering::instr(const Instr& in) {
+    switch (in.op) {
+    case Op::ADD_I32: case Op::SUB_I32: case Op::MUL_I32: case Op::SHL_I32:
+        intArith(in);
+        break;
+    case Op::DIV_I32: case Op::MOD_I32:
+        divMod(in);
+        break;
+    case Op::ADD_F32: case Op::SUB_F32: case Op::MUL_F32: case Op::DIV_F32:
+        floatArith(in, false);
+        break;
+    case Op::ADD_F64: case Op::SUB_F64: case Op::MUL_F64: case Op::DIV_F64:
+        floatArith(in, true);
+        break;
+    case Op::MOD_F32: floatMod(in, false); break;
+    case Op::MOD_F64: floatMod(in, true); break;
+    case Op::TEST_I32:
+        loadI(RAX, at(in.a));
+        as.op({}, false, {0x85}, RAX, RM::r(RAX));
+        setcc(CC_NE);
+        storeBool(in.dst);
+        break;
+    case Op::TEST_F32: case Op::TEST_F64: {
+        bool dbl = in.op == Op::TEST_F64;
+        loadF(dbl ? 0xF2 : 0xF3, XMM0, at(in.a));
+        as.op({}, false, {0x0F, 0x57}, XMM1, RM::r(XMM1));                  // xorps xmm1, xmm1
+        if (dbl) as.op({0x66}, false, {0x0F, 0x2E}, XMM0, RM::r(XMM1));
+        else as.op({}, false, {0x0F, 0x2E}, XMM0, RM::r(XMM1));
+        setccUnordered(CC_NE);
+        storeBool(in.dst);
+        break;
+    }
+    case Op::I32_TO_F32:
+        as.op({0xF3}, false, {0x0F, 0x2A}, XMM0, at(in.a)); // cvtsi2ss
+        storeF(0xF3, at(in.dst), XMM0);
+        break;
+    case Op::I32_TO_F64:
+        as.op({0xF2}, false, {0x0F, 0x2A}, XMM0, at(in.a)); // cvtsi2sd
+        storeF(0xF2, at(in.dst), XMM0);
+        break;
+    case Op::F32_TO_F64:
+        as.op({0xF3}, false, {0x0F, 0x5A}, XMM0, at(in.a)); // cvtss2sd
+        storeF(0xF2, at(in.dst), XMM0);
+        break;
+    case Op::MOV: {
+        // Copies the whole 8-byte register like the VM.
+        RM src = at(in.a), dst = at(in.dst);
+        if (!src.mem && inXmm(in.a)) {
+            storeF(0xF2, dst, src.reg);
+        } else if (!src.mem) {
+            as.op({}, true, {0x89}, src.reg, dst);
+        } else {
+            as.op({}, true, {0x8B}, RAX, src);
+            as.op({}, true, {0x89}, RAX, dst);
+        }
+        break;
+    }
+    case Op::JMP:
+        fixups.push_back({as.jmp(), in.a});
+        break;
+    case Op::JZ: case Op::JNZ:
+        loadI(RAX, at(in.a));
+        as.op({}, false, {0x85}, RAX, RM::r(RAX));
+        fixups.push_back({as.jcc(in.op == Op::JZ ? CC_E : CC_NE), in.b});
+        break;
+    case Op::HALT:
+        halts.push_back(as.jmp());
+        break;
+    default:
+        compare(in);
+    }
+}
+
+std::vector<uint8_t> X64Lowering::lower() {
+    prologue();
+    labels.resize(bc.code.size() + 1);
+    for (uint32_t i = 0; i < bc.code.size(); ++i) {
+        labels[i] = as.pos();
+        instr(bc.code[i]);
+    }
+    labels[bc.code.size()] = as.pos();
+    for (auto& f : fixups) as.bind(f.first, labels[f.second]);
+    epilogue();
+    return std::move(as.code);
+}
+
+} // namespace
+
+bool jitSupported() { return true; }
+
+JitProgram::JitProgram(const Bytecode& bc) {
+    std::vector<uint8_t> code = X64Lowering(bc).lower();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (code.size() + page - 1) / page * page;
+    mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = nullptr;
+        throw std::runtime_error("Could not allocate JIT memory");
+    }
+    std::memcpy(mem, code.data(), code.size());
+    // W^X: the buffer is never writable and executable at the same time.
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+        throw std::runtime_error("Could not make JIT memory executable");
+    entry = reinterpret_cast<Entry>(mem);
+}
+
+JitProgram::~JitProgram() {
+    if (mem) munmap(mem, size);
+}
+
+void JitProgram::run(const Bytecode& bc, std::vector<Reg>& regs) const {
+    regs.assign(bc.initial.begin(), bc.initial.end());
+    int status = entry(regs.data());
+    if (status == 1) throw std::runtime_error("Division by zero");
+    if (status == 2) throw std::runtime_error("Modulo by zero");
+}
+
+#else // !VOLT_JIT_X64
+
+bool jitSupported() { return false; }
+
+JitProgram::JitProgram(const Bytecode&) {
+    throw std::runtime_error("The JIT backend is only available on x86-64 POSIX hosts");
+}
+
+JitProgram::~JitProgram() {}
+
+void JitProgram::run(const Bytecode&, std::vector<Reg>&) const {}
+
+#endif
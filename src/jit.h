@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "vm.h"
+
+// In-process x86-64 backend (voltage --jit). The checked program is lowered
+// to the VM's register form with one virtual register per temporary, the
+// temporaries are assigned to general-purpose (int) or SSE2 (float/double)
+// registers by a linear-scan allocator, and the machine code is written to
+// an mmap'd buffer that is made executable and called directly. Variables and
+// constants stay in the VM register file, so results read back the same way.
+class JitProgram {
+    void* mem = nullptr;
+    size_t size = 0;
+    using Entry = int (*)(Reg* regs);
+    Entry entry = nullptr;
+public:
+    explicit JitProgram(const Bytecode& bc);
+    ~JitProgram();
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    size_t codeSize() const { return size; }
+    // Runs the code on `regs` (initialised from the bytecode's constants).
+    // Throws std::runtime_error on integer division by zero.
+    void run(const Bytecode& bc, std::vector<Reg>& regs) const;
+};
+
+// False on hosts the backend cannot generate code for.
+bool jitSupported();
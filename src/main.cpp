@@ -1,70 +1,505 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "cache.h"
+#include "codegen.h"
+#include "fold.h"
+#include "jit.h"
 #include "parser.h"
+#include "pool.h"
+#include "server.h"
+#include "sema.h"
+#include "source.h"
+#include "split.h"
+#include "stats.h"
+#include "vm.h"
+#include "voltc.h"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-<<<<<<< HEAD
-        std::cerr << "Usage: " << argv[0] << " <file.volt>" << std::endl;
-=======
-        std::cerr << "Errore: devi specificare un file da interpretare.\n";
-        std::cerr << "Esempio d'uso: " << argv[0] << " script.rn\n";
->>>>>>> origin/testing
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    bool ast_stats = false, fold = true, run = false, jit = false;
+    bool time_report = false, stats = false, split = false;
+    bool emit_voltc = false; // write a .voltc module instead of IR
+    IrCache* cache = nullptr; // --cache
+    CodeGenOptions gen;
+};
+
+// --split cuts a file into at most four chunks per worker, and none
+// smaller than this.
+constexpr size_t SPLIT_MIN_CHUNK = 64 * 1024;
+
+// One input file and where its IR goes; an empty output means stdout.
+struct Job {
+    std::string input, output;
+};
+
+const char* const KIND_NAMES[] = {"number", "variable", "binop", "logicop", "var_decl", "if",
+                                  "convert", "const",    "array", "index",   "splat",    "for"};
+constexpr size_t KIND_COUNT = sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]);
+static_assert(KIND_COUNT == static_cast<size_t>(NodeKind::FOR) + 1, "KIND_NAMES out of sync with NodeKind");
+
+std::string astKinds(const Ast& ast) {
+    size_t counts[KIND_COUNT] = {};
+    for (const Node& n : ast.nodes) ++counts[static_cast<size_t>(n.kind)];
+    std::string s = std::to_string(ast.nodes.size()) + " (";
+    for (size_t k = 0; k < KIND_COUNT; ++k)
+        s += (k ? ", " : "") + std::string(KIND_NAMES[k]) + ' ' + std::to_string(counts[k]);
+    return s + ")";
+}
+
+bool hasExtension(const std::string& f, const std::string& ext) {
+    return f.size() >= ext.size() && f.compare(f.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+bool hasVoltExtension(const std::string& f) { return hasExtension(f, ".volt"); }
+
+// Opens where a job's IR goes: its output file, or stdout after a banner.
+// Returns -1 after reporting an error.
+int openOutput(const Job& job, std::ostream& out, std::ostream& err) {
+    if (job.output.empty()) {
+        out << "----- OUTPUT LLVM IR -----" << std::endl;
         return 1;
     }
+    int fd = ::open(job.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) err << "Could not open output file " << job.output << ": " << std::strerror(errno) << std::endl;
+    return fd;
+}
 
-    std::string filename = argv[1];
-    if (filename.size() < 5 || filename.substr(filename.size() - 5) != ".volt") {
-        std::cerr << "Il file deve avere estensione .volt" << std::endl;
+// Compiles one file. Diagnostics and reports go to `err`, --run results to
+// `out`. Everything a compile touches (source, Ast, Context, IR buffer) is
+// local to the call, so files can be compiled on several threads at once.
+// With --split, a large file is itself compiled in chunks on `pool` (null
+// when the file is one task of a multi-file run); with --cache, the chunks
+// missing from the cache are. A .voltc input is loaded as it was checked,
+// skipping the front end.
+int compileFile(const Options& opt, const Job& job, Profiler& prof, std::ostream& out, std::ostream& err,
+                WorkStealingPool* pool) {
+    bool precompiled = hasExtension(job.input, ".voltc");
+    if (!precompiled && !hasVoltExtension(job.input)) {
+        err << "Il file deve avere estensione .volt o .voltc" << std::endl;
         return 1;
     }
 
-    std::ifstream infile(filename);
-    if (!infile) {
-        std::cerr << "Could not open file " << filename << std::endl;
+    size_t tokens = 0;
+    std::vector<std::pair<const char*, std::string>> counters; // for --stats
+    auto report = [&]() {
+        if (opt.stats) {
+            err << "----- stats -----\n";
+            for (const auto& c : counters) err << "  " << c.first << ": " << c.second << '\n';
+        }
+        if (opt.time_report || opt.stats) {
+            if (opt.time_report) err << "----- time report -----\n";
+            prof.print(err, opt.time_report, opt.stats);
+        }
+    };
+
+    std::unique_ptr<SourceFile> source;
+    std::unique_ptr<VoltcFile> voltc;
+    try {
+        Profiler::Scope phase(prof, "read");
+        if (precompiled) voltc = std::make_unique<VoltcFile>(job.input);
+        else source = std::make_unique<SourceFile>(job.input);
+    } catch (const std::exception& ex) {
+        err << ex.what() << std::endl;
         return 1;
     }
 
+    // --cache and --split compile the file in chunks. A chunk with an error
+    // sends the whole file down the sequential path below, which reports it
+    // with whole-file line numbers.
+    if (source && (opt.cache || (opt.split && pool)) && !opt.run && !opt.jit && !opt.ast_stats &&
+        !opt.emit_voltc) {
+        SplitModule module;
+        bool chunked = false;
+        size_t hits = 0, misses = 0;
+        if (opt.cache) {
+            chunked = compileCached(source->text(), *opt.cache, opt.fold, opt.gen, pool, prof, module, hits, misses);
+        } else {
+            size_t chunks = std::min<size_t>(pool->size() * 4, source->text().size() / SPLIT_MIN_CHUNK);
+            chunked = chunks > 1 && compileSplit(source->text(), static_cast<unsigned>(chunks), opt.fold,
+                                                 opt.gen, *pool, prof, module);
+        }
+        if (chunked) {
+            if (prof.isEnabled()) {
+                Profiler::Scope phase(prof, "lex", true);
+                tokens = Parser::countTokens(source->text());
+            }
+            int fd = openOutput(job, out, err);
+            if (fd < 0) return 1;
+            int status = 0;
+            try {
+                IrWriter ir(fd);
+                {
+                    Profiler::Scope phase(prof, "write");
+                    ir << moduleHeader();
+                    for (const std::string& part : module.parts) ir.write(part);
+                    ir.flush();
+                }
+                counters.push_back({"tokens", std::to_string(tokens)});
+                counters.push_back({"chunks", std::to_string(module.chunks)});
+                if (opt.cache) {
+                    counters.push_back({"cache hits", std::to_string(hits)});
+                    counters.push_back({"cache misses", std::to_string(misses)});
+                }
+                counters.push_back({"ast nodes", std::to_string(module.ast_nodes)});
+                counters.push_back({"ir instructions", std::to_string(module.instructions)});
+                counters.push_back({"cse removed", std::to_string(module.removed)});
+                counters.push_back({"ir temporaries", std::to_string(module.temporaries)});
+                counters.push_back({"ir bytes", std::to_string(ir.bytesWritten())});
+                report();
+            } catch (const std::exception& ex) {
+                err << "Error: " << ex.what() << std::endl;
+                status = 1;
+            }
+            if (fd != 1) ::close(fd);
+            return status;
+        }
+    }
+
+    // The whole file is lexed and parsed in one pass, so blocks such as
+    // if ... endif; may span several lines.
+    Ast ast;
     Context ctx;
-    std::string line;
-    std::ostringstream llvm_ir;
-    llvm_ir << "; ModuleID = 'volt_module'\n";
-    llvm_ir << "define i32 @main() {\n";
-
-    int lineno = 0;
-    while (std::getline(infile, line)) {
-        lineno++;
-        if (line.empty()) continue;
-        // Rimuove eventuali spazi finali
-        size_t end = line.find_last_not_of(" \t\r\n");
-        if (end == std::string::npos) continue;
-        line = line.substr(0, end + 1);
-
-        if (line.empty()) continue;
-
-        // Controllo rigido per il punto e virgola
-        if (line.back() != ';') {
-            std::cerr << "Errore: la riga " << lineno << " non termina con ';': " << line << std::endl;
+    if (voltc) {
+        // Folding cannot be undone, but an unfolded module can be folded now.
+        if (voltc->folded() && !opt.fold) {
+            err << "Error: " << job.input << " was written with constant folding; write it again with --no-fold"
+                << std::endl;
+            return 1;
+        }
+        try {
+            Profiler::Scope phase(prof, "load");
+            voltc->load(ast, ctx);
+        } catch (const std::exception& ex) {
+            err << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+    } else {
+        try {
+            if (prof.isEnabled()) {
+                // The parser pulls tokens on demand, so lexing is timed by a
+                // separate lexer-only pass; "parse" includes lexing.
+                Profiler::Scope phase(prof, "lex", true);
+                tokens = Parser::countTokens(source->text());
+            }
+            Profiler::Scope phase(prof, "parse");
+            ast = Parser::parseProgram(source->text());
+        } catch (const ParseError& ex) {
+            err << "Error: " << ex.what() << " in line " << source->lineOf(ex.offset)
+                << ": " << source->lineAt(ex.offset) << std::endl;
+            return 1;
+        }
+    }
+
+    if (opt.ast_stats) {
+        size_t bytes = ast.memoryUsage();
+        err << "ast: " << ast.nodes.size() << " nodes (" << sizeof(Node) << " bytes each), "
+            << ast.extra.size() << " extra words, " << ast.strings.size() << " interned strings, "
+            << bytes << " bytes total";
+        if (!ast.nodes.empty()) err << " (" << bytes / ast.nodes.size() << " bytes/node)";
+        err << std::endl;
+    }
+
+    if (source) {
+        Sema sema(ast, ctx);
+        bool checked;
+        {
+            Profiler::Scope phase(prof, "sema");
+            checked = sema.run();
+        }
+        if (!checked) {
+            for (const Diagnostic& d : sema.diagnostics())
+                err << "Error: " << d.message << " in line " << source->lineOf(d.offset)
+                    << ": " << source->lineAt(d.offset) << std::endl;
             return 1;
         }
+    }
+
+    if (opt.fold && !(voltc && voltc->folded())) {
+        Profiler::Scope phase(prof, "fold");
+        Folder(ast).run();
+    }
+    if (source) counters.push_back({"tokens", std::to_string(tokens)});
+    counters.push_back({"ast nodes", astKinds(ast)});
 
+    if (opt.emit_voltc) {
+        std::string path = job.output.empty() ? fs::path(job.input).replace_extension(".voltc").string() : job.output;
         try {
-            auto expr = Parser::parse(line);
-            std::string result_var;
-            llvm_ir << "  " << expr->toLLVMIR(ctx, result_var) << "\n";
+            Profiler::Scope phase(prof, "write");
+            writeVoltc(path, ast, ctx, opt.fold);
         } catch (const std::exception& ex) {
-            std::cerr << "Error: " << ex.what() << " in line " << lineno << ": " << line << std::endl;
+            err << "Error: " << ex.what() << std::endl;
             return 1;
         }
+        report();
+        return 0;
     }
 
-    llvm_ir << "  ret i32 0\n";
-    llvm_ir << "}\n";
+    // Direct execution on the bytecode VM or as native code; prints the final
+    // value of every top-level variable.
+    if (opt.run || opt.jit) {
+        Bytecode bc;
+        try {
+            Profiler::Scope phase(prof, "bytecode");
+            bc = compileBytecode(ast, !opt.jit);
+        } catch (const std::exception& ex) {
+            err << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        std::vector<Reg> regs;
+        try {
+            if (opt.jit) {
+                std::unique_ptr<JitProgram> code;
+                {
+                    Profiler::Scope phase(prof, "jit");
+                    code = std::make_unique<JitProgram>(bc);
+                }
+                Profiler::Scope phase(prof, "run");
+                code->run(bc, regs);
+            } else {
+                Profiler::Scope phase(prof, "run");
+                runBytecode(bc, regs);
+            }
+        } catch (const std::exception& ex) {
+            err << "Runtime error: " << ex.what() << std::endl;
+            return 1;
+        }
+        counters.push_back({"bytecode instructions", std::to_string(bc.code.size())});
+        report();
+        for (const Bytecode::Output& o : bc.outputs)
+            out << ast.str(o.name) << " = " << formatReg(regs[o.reg], o.type) << "\n";
+        return 0;
+    }
+
+    // IR goes straight from the code generator to the output file in
+    // bounded chunks; nothing holds the whole module text.
+    int fd = openOutput(job, out, err);
+    if (fd < 0) return 1;
+
+    int status = 0;
+    try {
+        IrWriter ir(fd);
+        CodeGen gen(ast, ctx, ir, opt.gen);
+        {
+            Profiler::Scope phase(prof, "codegen");
+            ir << moduleHeader();
+            gen.emitFunction();
+        }
+        {
+            Profiler::Scope phase(prof, "write");
+            ir.flush();
+        }
+        counters.push_back({"ir instructions", std::to_string(gen.instructionCount())});
+        counters.push_back({"cse removed", std::to_string(gen.removedInstructions())});
+        counters.push_back({"ir temporaries", std::to_string(ctx.temp_index)});
+        counters.push_back({"ir bytes", std::to_string(ir.bytesWritten())});
+        report();
+    } catch (const std::exception& ex) {
+        err << "Error: " << ex.what() << std::endl;
+        status = 1;
+    }
+    if (fd != 1) ::close(fd);
+    return status;
+}
+
+// Expands directory arguments into the .volt files below them, in path
+// order, and picks each file's IR output: beside the input, or under
+// out_dir (mirroring the layout below a directory argument) when given.
+// `extension` is that of the outputs: .ll, or .voltc with --emit-voltc.
+bool collectJobs(const std::vector<std::string>& args, const std::string& out_dir, const std::string& extension,
+                 std::vector<Job>& jobs) {
+    auto irName = [&](const fs::path& input, const fs::path& relative) {
+        fs::path ir = out_dir.empty() ? input : fs::path(out_dir) / relative;
+        return ir.replace_extension(extension).string();
+    };
+    for (const std::string& arg : args) {
+        std::error_code ec;
+        if (!fs::is_directory(arg, ec)) {
+            jobs.push_back({arg, irName(arg, fs::path(arg).filename())});
+            continue;
+        }
+        std::vector<fs::path> found;
+        for (fs::recursive_directory_iterator it(arg, ec), end; !ec && it != end; it.increment(ec))
+            if (it->is_regular_file() && hasVoltExtension(it->path().string())) found.push_back(it->path());
+        if (ec) {
+            std::cerr << "Could not read directory " << arg << ": " << ec.message() << std::endl;
+            return false;
+        }
+        std::sort(found.begin(), found.end());
+        for (const fs::path& p : found) jobs.push_back({p.string(), irName(p, p.lexically_relative(arg))});
+    }
+    return true;
+}
+
+// Writes a buffered per-file stream, each line prefixed with the file name.
+void writePrefixed(std::ostream& os, const std::string& file, const std::string& text) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        size_t end = nl == std::string::npos ? text.size() : nl + 1;
+        os << file << ": ";
+        os.write(text.data() + pos, static_cast<std::streamsize>(end - pos));
+        if (nl == std::string::npos) os << '\n';
+        pos = end;
+    }
+}
+
+} // namespace
 
-    std::cout << "----- OUTPUT LLVM IR -----" << std::endl;
-    std::cout << llvm_ir.str();
+int main(int argc, char* argv[]) {
+    Options opt;
+    std::vector<std::string> inputs;
+    std::string output, trace, cache_dir, serve_socket, connect_socket;
+    std::vector<std::string> request; // --connect
+    unsigned threads = 0;
+    uint64_t cache_limit_mb = 256;
+    bool cache_stats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ast-stats") opt.ast_stats = true;
+        else if (arg == "--no-fold") opt.fold = false;
+        else if (arg == "--no-switch") opt.gen.switches = false;
+        else if (arg == "--no-cse") opt.gen.cse = false;
+        else if (arg == "--fast-math") opt.gen.fast_math = true;
+        else if (arg == "--run") opt.run = true;
+        else if (arg == "--jit") opt.jit = true;
+        else if (arg == "--time-report") opt.time_report = true;
+        else if (arg == "--stats") opt.stats = true;
+        else if (arg == "--split") opt.split = true;
+        else if (arg == "--emit-voltc") opt.emit_voltc = true;
+        else if (arg == "--cache" && i + 1 < argc) cache_dir = argv[++i];
+        else if (arg == "--cache-limit" && i + 1 < argc) cache_limit_mb = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--cache-stats") cache_stats = true;
+        else if (arg == "--serve" && i + 1 < argc) serve_socket = argv[++i];
+        else if (arg == "--connect" && i + 1 < argc) {
+            // The rest of the line is the request, options included.
+            connect_socket = argv[++i];
+            request.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        else if (arg == "--trace" && i + 1 < argc) trace = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+        else if (arg == "-j" && i + 1 < argc) threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else inputs.push_back(arg);
+    }
+    if (!serve_socket.empty()) return serve({serve_socket, threads, cache_limit_mb << 20});
+    if (!connect_socket.empty() && !request.empty()) return serveRequest(connect_socket, request);
+    if (inputs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--run | --jit] [--ast-stats] [--no-fold] [--no-switch] [--no-cse]"
+                  << " [--fast-math] [--time-report] [--stats] [--trace <file.json>] [-j <threads>] [--split]"
+                  << " [--cache <dir> [--cache-limit <MB>] [--cache-stats]]"
+                  << " [--emit-voltc] [-o <file.ll | file.voltc | dir>] <file.volt | file.voltc | dir>..."
+                  << std::endl;
+        std::cerr << "       " << argv[0] << " --serve <socket> [-j <threads>] [--cache-limit <MB>]" << std::endl;
+        std::cerr << "       " << argv[0] << " --connect <socket> compile|run [--no-fold] [--no-switch] [--no-cse]"
+                  << " [--fast-math] <file.volt>"
+                  << " | stats | shutdown" << std::endl;
+        return 1;
+    }
 
-    return 0;
+    // Phases are only measured when one of the reports asks for them.
+    bool profile = opt.time_report || opt.stats || !trace.empty();
+    auto origin = Profiler::Clock::now();
+    auto writeTrace = [&](const std::vector<const Profiler*>& profs) {
+        if (trace.empty()) return true;
+        try {
+            Profiler::writeTrace(trace, profs);
+        } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    // The cache is trimmed to its limit once every file is compiled.
+    std::unique_ptr<IrCache> cache;
+    if (!cache_dir.empty()) {
+        try {
+            cache = std::make_unique<IrCache>(cache_dir);
+        } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        opt.cache = cache.get();
+    }
+    auto trimCache = [&] {
+        if (!cache) return;
+        IrCache::Usage u = cache->trim(cache_limit_mb << 20);
+        if (cache_stats)
+            std::cerr << "cache: " << cache->hits() << " hits, " << cache->misses() << " misses, " << u.evicted
+                      << " evicted, " << u.entries << " entries, " << (u.bytes + 1023) / 1024 << " KB of "
+                      << cache_limit_mb << " MB" << std::endl;
+    };
+
+    std::error_code ec;
+    if (inputs.size() == 1 && !fs::is_directory(inputs[0], ec)) {
+        Profiler prof(profile, origin);
+        prof.setSource(inputs[0], 0);
+        std::unique_ptr<WorkStealingPool> pool;
+        if (opt.split || opt.cache) pool = std::make_unique<WorkStealingPool>(threads);
+        int status = compileFile(opt, {inputs[0], output}, prof, std::cout, std::cerr, pool.get());
+        trimCache();
+        return writeTrace({&prof}) ? status : 1;
+    }
+
+    // Several inputs: each file is one task on the pool, its IR goes to its
+    // own .ll file, and everything it prints is buffered and written out in
+    // input order once all files are done.
+    std::vector<Job> jobs;
+    if (!collectJobs(inputs, output, opt.emit_voltc ? ".voltc" : ".ll", jobs)) return 1;
+    if (!output.empty() && (opt.emit_voltc || (!opt.run && !opt.jit))) {
+        for (const Job& j : jobs) {
+            fs::path dir = fs::path(j.output).parent_path();
+            if (!dir.empty() && !fs::create_directories(dir, ec) && ec) {
+                std::cerr << "Could not create directory " << dir.string() << ": " << ec.message() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    struct Result {
+        std::ostringstream out, err;
+        std::unique_ptr<Profiler> prof;
+        int status = 0;
+    };
+    std::vector<Result> results(jobs.size());
+    for (Result& r : results) r.prof = std::make_unique<Profiler>(profile, origin);
+
+    WorkStealingPool pool(threads);
+    pool.parallelFor(jobs.size(), [&](size_t i, unsigned worker) {
+        Result& r = results[i];
+        r.prof->setSource(jobs[i].input, worker);
+        try {
+            r.status = compileFile(opt, jobs[i], *r.prof, r.out, r.err, nullptr);
+        } catch (const std::exception& ex) {
+            r.err << "Error: " << ex.what() << std::endl;
+            r.status = 1;
+        }
+    });
+
+    int status = 0;
+    std::vector<const Profiler*> profs;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        writePrefixed(std::cout, jobs[i].input, results[i].out.str());
+        writePrefixed(std::cerr, jobs[i].input, results[i].err.str());
+        if (results[i].status) status = 1;
+        profs.push_back(results[i].prof.get());
+    }
+    std::cout.flush();
+    trimCache();
+    return writeTrace(profs) ? status : 1;
 }
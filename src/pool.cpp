@@ -0,0 +1,97 @@
+#include "pool.h"
+
+unsigned hardwareThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned n) {
+    if (n == 0) n = hardwareThreads();
+    for (unsigned i = 0; i < n; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < n; ++i) threads.emplace_back([this, i] { workerLoop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+}
+
+bool WorkStealingPool::take(unsigned worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.m);
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (unsigned k = 1; k < size(); ++k) {
+        Queue& victim = *queues[(worker + k) % size()];
+        std::lock_guard<std::mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::drain(unsigned worker) {
+    size_t index;
+    while (take(worker, index)) {
+        try {
+            (*job)(index, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_m);
+            if (!error || index < error_index) {
+                error = std::current_exception();
+                error_index = index;
+            }
+        }
+    }
+}
+
+void WorkStealingPool::workerLoop(unsigned worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        drain(worker);
+        std::lock_guard<std::mutex> lock(m);
+        if (--running == 0) done.notify_one();
+    }
+}
+
+void WorkStealingPool::parallelFor(size_t n, const Task& task) {
+    if (n == 0) return;
+    size_t w = size();
+    for (size_t i = 0; i < w; ++i) {
+        std::lock_guard<std::mutex> lock(queues[i]->m);
+        for (size_t t = i * n / w; t < (i + 1) * n / w; ++t) queues[i]->tasks.push_back(t);
+    }
+    error = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        job = &task;
+        running = static_cast<unsigned>(threads.size());
+        ++generation;
+    }
+    wake.notify_all();
+    drain(0);
+    {
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [&] { return running == 0; });
+        job = nullptr;
+    }
+    if (error) std::rethrow_exception(error);
+}
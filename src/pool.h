@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run the tasks of one parallelFor call.
+//
+// Tasks 0..n-1 are dealt to per-worker deques in contiguous blocks. A worker
+// takes tasks from the front of its own deque, in index order; once it is
+// empty it steals from the back of the other workers' deques, so a few
+// large tasks do not leave the other threads idle. Tasks cannot spawn
+// tasks, so a worker that finds every deque empty is done.
+class WorkStealingPool {
+public:
+    using Task = std::function<void(size_t index, unsigned worker)>;
+
+    // threads == 0 uses one worker per hardware thread. The calling thread
+    // is worker 0, so threads - 1 are started.
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // Runs task(i, worker) for every i in [0, n) and returns once all have
+    // finished. If tasks throw, the exception of the lowest index is
+    // rethrown after the others have run.
+    void parallelFor(size_t n, const Task& task);
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker
+    std::vector<std::thread> threads;           // workers 1..size()-1
+
+    std::mutex m;
+    std::condition_variable wake, done;
+    const Task* job = nullptr;
+    uint64_t generation = 0;
+    unsigned running = 0; // started workers still in the current job
+    bool stopping = false;
+
+    std::mutex error_m;
+    std::exception_ptr error;
+    size_t error_index = 0;
+
+    bool take(unsigned worker, size_t& index);
+    void drain(unsigned worker);
+    void workerLoop(unsigned worker);
+};
+
+// Default worker count: hardware threads, at least 1.
+unsigned hardwareThreads();
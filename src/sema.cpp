@@ -0,0 +1,322 @@
+#include "sema.h"
+#include <algorithm>
+
+namespace {
+
+const char* typeName(VoltType t) {
+    switch (t) {
+        case VoltType::INT: return "int";
+        case VoltType::FLOAT: return "float";
+        case VoltType::DOUBLE: return "double";
+        case VoltType::I8: return "i8";
+        case VoltType::I16: return "i16";
+        case VoltType::I64: return "i64";
+        case VoltType::U8: return "u8";
+        case VoltType::U16: return "u16";
+        case VoltType::U32: return "u32";
+        case VoltType::U64: return "u64";
+    }
+    return "int";
+}
+
+// "int", or "int[4]" for an array.
+std::string typeName(VoltType t, uint8_t length) {
+    if (length == 0) return typeName(t);
+    return std::string(typeName(t)) + '[' + std::to_string(length) + ']';
+}
+
+// Integers < float < double; between integers the wider one wins, and the
+// unsigned one at equal width, as in C.
+VoltType wider(VoltType a, VoltType b) {
+    if (a == b) return a;
+    if (isFloatType(a) || isFloatType(b))
+        return a == VoltType::DOUBLE || b == VoltType::DOUBLE ? VoltType::DOUBLE : VoltType::FLOAT;
+    if (intBits(a) != intBits(b)) return intBits(a) > intBits(b) ? a : b;
+    return isUnsignedType(a) ? a : b;
+}
+
+// Whether the integer literal `digits` fits in t. A negated literal may also
+// be the magnitude of t's minimum, as in -128 for i8.
+bool fits(std::string_view digits, VoltType t, bool negated) {
+    uint64_t value = 0;
+    for (char c : digits) {
+        uint64_t d = static_cast<uint64_t>(c - '0');
+        if (value > (UINT64_MAX - d) / 10) return false;
+        value = value * 10 + d;
+    }
+    unsigned bits = intBits(t);
+    if (isUnsignedType(t)) return bits == 64 || value < (uint64_t{1} << bits);
+    uint64_t max = (uint64_t{1} << (bits - 1)) - 1;
+    return value <= max || (negated && value == max + 1);
+}
+
+} // namespace
+
+bool Sema::run() {
+    ctx.resize(ast.strings.size());
+    for (size_t i = 0; i < ast.roots.size(); ++i) {
+        stmt_offset = ast.offsets[i];
+        statement(ast.roots[i]);
+    }
+    return diags.empty();
+}
+
+uint32_t Sema::promote(uint32_t n, VoltType to) {
+    if (ast[n].type == to) return n;
+    return ast.add(Node{NodeKind::CONVERT, 0, to, ast[n].flags, n, 0});
+}
+
+uint32_t Sema::splat(uint32_t n, uint8_t length) {
+    if (ast[n].flags == length) return n;
+    return ast.add(Node{NodeKind::SPLAT, 0, ast[n].type, length, n, 0});
+}
+
+// Promotes both operands to the wider type and repeats a scalar operand over
+// the length of an array one; returns that length.
+uint8_t Sema::unify(uint32_t n, VoltType t) {
+    Node node = ast[n];
+    uint8_t la = ast[node.a].flags, lb = ast[node.b].flags;
+    if (la && lb && la != lb)
+        error("Cannot combine " + typeName(ast[node.a].type, la) + " and " + typeName(ast[node.b].type, lb) +
+              " values");
+    uint8_t length = la ? la : lb;
+    uint32_t l = splat(promote(node.a, t), length);
+    uint32_t r = splat(promote(node.b, t), length);
+    ast.nodes[n].a = l;
+    ast.nodes[n].b = r;
+    return length;
+}
+
+// Gives the untyped literal tree at n the type t (which must be an integer
+// type) and reports the literals in it that do not fit.
+void Sema::settle(uint32_t n, VoltType t) {
+    if (!isUntyped(n)) return;
+    std::vector<std::pair<uint32_t, bool>> work{{n, false}}; // node, negated
+    while (!work.empty()) {
+        auto [m, negated] = work.back();
+        work.pop_back();
+        untyped[m] = false;
+        ast.nodes[m].type = t;
+        const Node& node = ast[m];
+        if (node.kind == NodeKind::NUMBER) {
+            if (!fits(ast.str(node.a), t, negated))
+                error("Integer literal " + std::string(ast.str(node.a)) + " does not fit in " + typeName(t));
+        } else if (node.kind == NodeKind::BINOP) {
+            // -x is parsed as 0 - x.
+            const Node& l = ast[node.a];
+            bool negates = node.op == MINUS && l.kind == NodeKind::NUMBER && ast.str(l.a) == "0";
+            work.push_back({node.a, false});
+            work.push_back({node.b, negates});
+        } else if (node.kind == NodeKind::ARRAY) {
+            for (uint32_t i = 0; i < node.b; ++i) work.push_back({ast.extra[node.a + i], false});
+        } else if (node.kind == NodeKind::SPLAT) {
+            work.push_back({node.a, negated});
+        }
+    }
+}
+
+// Gives an untyped operand the integer type of the other one, or int when
+// that one is a float or untyped too.
+void Sema::meet(uint32_t a, uint32_t b) {
+    auto typeFor = [&](uint32_t other) {
+        VoltType t = ast[other].type;
+        return isUntyped(other) || isFloatType(t) ? VoltType::INT : t;
+    };
+    settle(a, typeFor(b));
+    settle(b, typeFor(a));
+}
+
+void Sema::statement(uint32_t n) {
+    switch (ast[n].kind) {
+    case NodeKind::VAR_DECL: {
+        expr(ast[n].b);
+        VoltType declared = ast[n].type;
+        settle(ast[n].b, isFloatType(declared) ? VoltType::INT : declared);
+        uint8_t length = ast[n].flags;
+        const Node& value = ast[ast[n].b];
+        uint32_t sym = ast[n].a;
+        // A value converts only to a type at least as wide; a scalar is
+        // repeated over an array, and an array never shrinks to a scalar.
+        if (wider(value.type, declared) != declared || (value.flags != 0 && value.flags != length)) {
+            error("Cannot assign a " + typeName(value.type, value.flags) + " value to " +
+                  typeName(declared, length) + " variable '" + std::string(ast.str(sym)) + "'");
+        } else {
+            uint32_t v = splat(promote(ast[n].b, declared), length);
+            ast.nodes[n].b = v;
+        }
+        if (!ctx.declared[sym]) {
+            ctx.declared[sym] = true;
+            ctx.var_types[sym] = declared;
+            ctx.lengths[sym] = length;
+            declared_names.push_back(sym);
+        } else if (ctx.var_types[sym] != declared || ctx.lengths[sym] != length) {
+            error("Variable '" + std::string(ast.str(sym)) + "' redeclared as " + typeName(declared, length) +
+                  ", previously " + typeName(ctx.var_types[sym], ctx.lengths[sym]));
+        }
+        break;
+    }
+    case NodeKind::IF: {
+        Node ifNode = ast[n];
+        for (uint32_t i = 0; i < ifNode.b; ++i) {
+            IfBranch br = ast.branch(ifNode, i);
+            if (br.cond != NO_NODE) {
+                expr(br.cond);
+                settle(br.cond, VoltType::INT);
+                const Node& c = ast[br.cond];
+                if (c.flags) error("An if condition must be a scalar, not " + typeName(c.type, c.flags));
+            }
+            // Variables first declared inside a branch are local to it.
+            size_t scope = declared_names.size();
+            for (uint32_t k = 0; k < br.count; ++k) statement(ast.stmt(br, k));
+            for (size_t k = scope; k < declared_names.size(); ++k) ctx.declared[declared_names[k]] = false;
+            declared_names.resize(scope);
+        }
+        ast.nodes[n].type = VoltType::INT;
+        break;
+    }
+    case NodeKind::FOR: {
+        ForLoop loop = ast.loop(ast[n]);
+        for (uint32_t bound : {loop.from, loop.until}) {
+            expr(bound);
+            settle(bound, VoltType::INT);
+            if (ast[bound].type != VoltType::INT || ast[bound].flags)
+                error("Loop bounds must be int values, not " + typeName(ast[bound].type, ast[bound].flags));
+        }
+        // The loop variable is an int local to the body, like a variable
+        // first declared inside it.
+        size_t scope = declared_names.size();
+        if (ctx.declared[loop.var]) {
+            error("Loop variable '" + std::string(ast.str(loop.var)) + "' is already declared");
+        } else {
+            ctx.declared[loop.var] = true;
+            ctx.var_types[loop.var] = VoltType::INT;
+            ctx.lengths[loop.var] = 0;
+            declared_names.push_back(loop.var);
+        }
+        IfBranch body = loop.body();
+        for (uint32_t k = 0; k < body.count; ++k) statement(ast.stmt(body, k));
+        for (size_t k = scope; k < declared_names.size(); ++k) ctx.declared[declared_names[k]] = false;
+        declared_names.resize(scope);
+        ast.nodes[n].type = VoltType::INT;
+        break;
+    }
+    default:
+        expr(n);
+        settle(n, VoltType::INT);
+    }
+}
+
+// Post-order walk with an explicit stack, so long operator chains cannot
+// overflow the native stack and every node is typed exactly once.
+void Sema::expr(uint32_t root) {
+    stack.push_back({root, false});
+    while (!stack.empty()) {
+        auto [n, children_done] = stack.back();
+        stack.pop_back();
+        NodeKind kind = ast[n].kind;
+        if (!children_done && (kind == NodeKind::BINOP || kind == NodeKind::LOGICOP || kind == NodeKind::INDEX)) {
+            stack.push_back({n, true});
+            stack.push_back({ast[n].b, false});
+            stack.push_back({ast[n].a, false});
+            continue;
+        }
+        if (!children_done && kind == NodeKind::ARRAY) {
+            stack.push_back({n, true});
+            for (uint32_t i = ast[n].b; i-- > 0;) stack.push_back({ast.extra[ast[n].a + i], false});
+            continue;
+        }
+        typeNode(n);
+    }
+}
+
+void Sema::typeNode(uint32_t n) {
+    Node node = ast[n];
+    switch (node.kind) {
+    case NodeKind::NUMBER:
+        if (!isFloatType(node.type)) markUntyped(n);
+        break;
+    case NodeKind::CONST:
+    case NodeKind::CONVERT:
+    case NodeKind::SPLAT:
+        break;
+    case NodeKind::VARIABLE:
+        if (!ctx.declared[node.a]) {
+            error("Undefined variable: " + std::string(ast.str(node.a)));
+            ast.nodes[n].type = VoltType::INT;
+        } else {
+            ast.nodes[n].type = ctx.var_types[node.a];
+            ast.nodes[n].flags = ctx.lengths[node.a];
+        }
+        break;
+    case NodeKind::BINOP:
+        if (node.op == AND || node.op == OR) {
+            // Each operand is tested against zero in its own type.
+            settle(node.a, VoltType::INT);
+            settle(node.b, VoltType::INT);
+            if (ast[node.a].flags || ast[node.b].flags)
+                error(std::string("Operands of '") + (node.op == AND ? "&&" : "||") + "' must be scalars");
+            ast.nodes[n].type = VoltType::INT;
+        } else if (isUntyped(node.a) && isUntyped(node.b)) {
+            // Arithmetic on literals only is typed by where it is used.
+            ast.nodes[n].flags = unify(n, VoltType::INT);
+            ast.nodes[n].type = VoltType::INT;
+            markUntyped(ast[n].a);
+            markUntyped(ast[n].b);
+            markUntyped(n);
+        } else {
+            meet(node.a, node.b);
+            VoltType t = wider(ast[node.a].type, ast[node.b].type);
+            ast.nodes[n].flags = unify(n, t);
+            ast.nodes[n].type = t;
+        }
+        break;
+    case NodeKind::LOGICOP:
+        // Arrays compare element by element into an int array of 0 / 1.
+        meet(node.a, node.b);
+        ast.nodes[n].flags = unify(n, wider(ast[node.a].type, ast[node.b].type));
+        ast.nodes[n].type = VoltType::INT;
+        break;
+    case NodeKind::ARRAY: {
+        // The literal elements take the type of the others; an array of
+        // literals only is typed by where it is used, like a literal.
+        bool literals = true;
+        VoltType t = VoltType::INT;
+        for (uint32_t i = 0; i < node.b; ++i) {
+            uint32_t e = ast.extra[node.a + i];
+            if (ast[e].flags) error("Array elements must be scalars, not " + typeName(ast[e].type, ast[e].flags));
+            if (isUntyped(e)) continue;
+            t = literals ? ast[e].type : wider(t, ast[e].type);
+            literals = false;
+        }
+        if (node.b > MAX_ARRAY_LENGTH)
+            error("Array literal has " + std::to_string(node.b) + " elements, at most " +
+                  std::to_string(MAX_ARRAY_LENGTH) + " are allowed");
+        if (literals && node.b) markUntyped(n);
+        for (uint32_t i = 0; i < node.b && !literals; ++i) {
+            settle(ast.extra[node.a + i], isFloatType(t) ? VoltType::INT : t);
+            uint32_t e = promote(ast.extra[node.a + i], t);
+            ast.extra[node.a + i] = e;
+        }
+        ast.nodes[n].type = t;
+        ast.nodes[n].flags = static_cast<uint8_t>(std::min<uint32_t>(node.b, MAX_ARRAY_LENGTH));
+        break;
+    }
+    case NodeKind::INDEX: {
+        settle(node.a, VoltType::INT);
+        settle(node.b, VoltType::INT);
+        const Node& array = ast[node.a];
+        const Node& index = ast[node.b];
+        if (!array.flags) error(std::string("Cannot index a ") + typeName(array.type) + " value");
+        if (isFloatType(index.type) || index.flags)
+            error("Array index must be an integer, not " + typeName(index.type, index.flags));
+        ast.nodes[n].type = array.type;
+        ast.nodes[n].flags = 0;
+        break;
+    }
+    case NodeKind::VAR_DECL:
+    case NodeKind::IF:
+    case NodeKind::FOR:
+        // Only reached through statement().
+        break;
+    }
+}
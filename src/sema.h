@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "parser.h"
+
+struct Diagnostic {
+    std::string message;
+    uint32_t offset; // source offset of the enclosing top-level statement
+};
+
+// Type checking pass run once before code generation. It resolves the type
+// of every node into Node::type, wraps operands that need an int->float->
+// double promotion in CONVERT nodes (and scalars used with arrays in SPLAT
+// nodes) and collects every error of the module. An integer literal, or
+// arithmetic on literals only, takes the integer type of the operand it
+// meets or of the variable it declares, and int anywhere else.
+class Sema {
+    Ast& ast;
+    Context& ctx;
+    std::vector<Diagnostic> diags;
+    std::vector<std::pair<uint32_t, bool>> stack; // expression walk: node, children done
+    std::vector<uint32_t> declared_names;         // declaration order, for block scoping
+    std::vector<bool> untyped;                    // integer literal trees not given a type yet
+    uint32_t stmt_offset = 0;
+
+    void error(const std::string& msg) { diags.push_back({msg, stmt_offset}); }
+    void statement(uint32_t n);
+    void expr(uint32_t root);
+    void typeNode(uint32_t n);
+    uint32_t promote(uint32_t n, VoltType to);
+    uint32_t splat(uint32_t n, uint8_t length);
+    uint8_t unify(uint32_t n, VoltType t);
+    bool isUntyped(uint32_t n) const { return n < untyped.size() && untyped[n]; }
+    void markUntyped(uint32_t n) {
+        if (untyped.size() <= n) untyped.resize(ast.nodes.size());
+        untyped[n] = true;
+    }
+    void settle(uint32_t n, VoltType t);
+    void meet(uint32_t a, uint32_t b);
+public:
+    Sema(Ast& a, Context& c) : ast(a), ctx(c) {}
+    // Returns false if any error was reported.
+    bool run();
+    const std::vector<Diagnostic>& diagnostics() const { return diags; }
+};
@@ -0,0 +1,537 @@
+#include "server.h"
+#include <iostream>
+
+#ifdef __linux__
+#define VOLT_SERVE 1
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cache.h"
+#include "codegen.h"
+#include "fold.h"
+#include "irwriter.h"
+#include "pool.h"
+#include "sema.h"
+#include "source.h"
+#include "vm.h"
+#endif
+
+#ifdef VOLT_SERVE
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Latencies kept per request kind; percentiles cover the most recent ones.
+constexpr size_t LATENCY_SAMPLES = 4096;
+// A connection whose request line grows past this is closed.
+constexpr size_t MAX_REQUEST = 64 * 1024;
+
+volatile std::sig_atomic_t stop_requested = 0;
+void onSignal(int) { stop_requested = 1; }
+
+// Chunk IR kept in memory for all files; a chunk's key covers everything
+// its IR depends on, so files with the same statements share entries.
+class MemoryStore : public ChunkStore {
+    struct Entry {
+        ChunkIr chunk;
+        uint64_t used = 0; // tick of the last load or store
+        size_t bytes = 0;
+    };
+    std::mutex m;
+    std::unordered_map<uint64_t, Entry> entries;
+    uint64_t tick = 0;
+    size_t total = 0;
+public:
+    bool load(uint64_t key, ChunkIr& chunk) override {
+        std::lock_guard<std::mutex> lock(m);
+        auto it = entries.find(key);
+        if (it == entries.end()) return false;
+        it->second.used = ++tick;
+        chunk = it->second.chunk;
+        return true;
+    }
+    void store(uint64_t key, const ChunkIr& chunk) override {
+        size_t bytes = sizeof(Entry) + chunk.ir.size();
+        for (const ChunkIr::Var& v : chunk.used) bytes += sizeof v + v.name.size();
+        for (const ChunkIr::Var& v : chunk.exports) bytes += sizeof v + v.name.size() + v.value.size();
+        std::lock_guard<std::mutex> lock(m);
+        Entry& e = entries[key];
+        total = total - e.bytes + bytes;
+        e.chunk = chunk;
+        e.used = ++tick;
+        e.bytes = bytes;
+    }
+    // Evicts the least recently used chunks until at most `limit` bytes remain.
+    void trim(uint64_t limit) {
+        std::lock_guard<std::mutex> lock(m);
+        if (total <= limit) return;
+        std::vector<std::pair<uint64_t, uint64_t>> order; // used, key
+        for (const auto& e : entries) order.push_back({e.second.used, e.first});
+        std::sort(order.begin(), order.end());
+        for (size_t i = 0; i < order.size() && total > limit; ++i) {
+            auto it = entries.find(order[i].second);
+            total -= it->second.bytes;
+            entries.erase(it);
+        }
+    }
+    size_t size() const { return entries.size(); }
+    size_t bytes() const { return total; }
+};
+
+class Latencies {
+    std::vector<double> samples; // milliseconds, a ring of the latest
+    size_t next = 0;
+    uint64_t count = 0;
+public:
+    void add(double ms) {
+        if (samples.size() < LATENCY_SAMPLES) samples.push_back(ms);
+        else samples[next] = ms;
+        next = (next + 1) % LATENCY_SAMPLES;
+        ++count;
+    }
+    std::string summary() const {
+        if (samples.empty()) return "0 requests";
+        std::vector<double> s = samples;
+        std::sort(s.begin(), s.end());
+        auto pct = [&](double p) { return s[std::max<size_t>(static_cast<size_t>(std::ceil(p * s.size())), 1) - 1]; };
+        char buf[160];
+        std::snprintf(buf, sizeof buf, "%llu requests, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms",
+                      static_cast<unsigned long long>(count), pct(0.5), pct(0.9), pct(0.99), s.back());
+        return buf;
+    }
+};
+
+struct Reply {
+    bool ok;
+    std::string body;
+};
+
+enum Kind { COMPILE, RUN, STATS, OTHER };
+const char* const KIND_NAMES[] = {"compile", "run", "stats"};
+
+// Request options that change the reply; a file keeps one reply per mode.
+enum Mode { SWITCHES = 1, FOLD = 2, EXECUTE = 4, CSE = 8, FAST_MATH = 16 };
+
+struct Watched {
+    std::string source;  // the file's contents when last read
+    bool fresh = false;  // no change reported since then
+    std::unordered_map<int, Reply> replies; // by Mode bits, for `source`
+};
+
+bool readFile(const std::string& path, std::string& text) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+bool sendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+// Parses and checks `source` as voltage does; on errors, returns false
+// with the messages voltage prints.
+bool check(std::string_view source, bool fold, Ast& ast, Context& ctx, std::string& errors) {
+    auto message = [&](const std::string& what, uint32_t offset) {
+        errors += "Error: " + what + " in line " + std::to_string(lineOf(source, offset)) + ": " +
+                  std::string(lineAt(source, offset)) + '\n';
+    };
+    try {
+        ast = Parser::parseProgram(source);
+    } catch (const ParseError& ex) {
+        message(ex.what(), ex.offset);
+        return false;
+    }
+    Sema sema(ast, ctx);
+    if (!sema.run()) {
+        for (const Diagnostic& d : sema.diagnostics()) message(d.message, d.offset);
+        return false;
+    }
+    if (fold) Folder(ast).run();
+    return true;
+}
+
+class Server {
+    const ServeOptions& opt;
+    WorkStealingPool pool;
+    MemoryStore chunks;
+    int inotify;
+    std::unordered_map<int, std::string> watch_dirs; // watch descriptor -> directory
+    std::unordered_map<std::string, Watched> files;  // by absolute path
+    Latencies latency[OTHER];
+    uint64_t refreshes = 0, chunk_hits = 0, chunk_misses = 0;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    Reply other; // a reply that is not kept with a file
+
+    Reply compileModule(std::string_view source, int mode);
+    Reply runModule(std::string_view source, int mode);
+    const Reply& reply(const std::string& path, int mode);
+    Reply stats() const;
+    const Reply& handle(std::string_view line, Kind& kind);
+public:
+    bool stopping = false;
+
+    explicit Server(const ServeOptions& o)
+        : opt(o), pool(o.threads), inotify(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+    ~Server() {
+        if (inotify >= 0) ::close(inotify);
+    }
+    // -1 when inotify is unavailable; every request then reads its file.
+    int watchFd() const { return inotify; }
+    // Handles one request line and sends the reply; false if the client is gone.
+    bool answer(int fd, std::string_view line);
+    // Reads the pending inotify events and compiles the changed files again.
+    void onChanges();
+};
+
+Reply Server::compileModule(std::string_view source, int mode) {
+    bool fold = mode & FOLD;
+    CodeGenOptions gen_opts;
+    gen_opts.switches = mode & SWITCHES;
+    gen_opts.cse = mode & CSE;
+    gen_opts.fast_math = mode & FAST_MATH;
+    SplitModule module;
+    size_t hits = 0, misses = 0;
+    Profiler prof(false);
+    if (compileCached(source, chunks, fold, gen_opts, &pool, prof, module, hits, misses)) {
+        chunk_hits += hits;
+        chunk_misses += misses;
+        chunks.trim(opt.memory_limit);
+        std::string ir = moduleHeader();
+        size_t size = ir.size();
+        for (const std::string& part : module.parts) size += part.size();
+        ir.reserve(size);
+        for (const std::string& part : module.parts) ir += part;
+        return {true, std::move(ir)};
+    }
+    // A chunk has an error: compile the whole file, for diagnostics with
+    // whole-file line numbers.
+    Ast ast;
+    Context ctx;
+    std::string errors;
+    if (!check(source, fold, ast, ctx, errors)) return {false, errors};
+    IrWriter ir;
+    CodeGen gen(ast, ctx, ir, gen_opts);
+    ir << moduleHeader();
+    gen.emitFunction();
+    return {true, ir.takeText()};
+}
+
+Reply Server::runModule(std::string_view source, int mode) {
+    Ast ast;
+    Context ctx;
+    std::string errors;
+    if (!check(source, mode & FOLD, ast, ctx, errors)) return {false, errors};
+    Bytecode bc;
+    try {
+        bc = compileBytecode(ast);
+    } catch (const std::exception& ex) {
+        return {false, std::string("Error: ") + ex.what() + '\n'};
+    }
+    std::vector<Reg> regs;
+    try {
+        runBytecode(bc, regs);
+    } catch (const std::exception& ex) {
+        return {false, std::string("Runtime error: ") + ex.what() + '\n'};
+    }
+    std::string out;
+    for (const Bytecode::Output& o : bc.outputs)
+        out += std::string(ast.str(o.name)) + " = " + formatReg(regs[o.reg], o.type) + '\n';
+    return {true, std::move(out)};
+}
+
+// The kept reply, after reading the file again if it may have changed.
+const Reply& Server::reply(const std::string& path, int mode) {
+    Watched& w = files[path];
+    if (!w.fresh) {
+        if (inotify >= 0) {
+            std::string dir = fs::path(path).parent_path().string();
+            int wd = ::inotify_add_watch(inotify, dir.c_str(),
+                                         IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+            if (wd >= 0) watch_dirs[wd] = dir;
+            w.fresh = wd >= 0;
+        }
+        std::string text;
+        if (!readFile(path, text)) {
+            files.erase(path);
+            return other = {false, "Could not open file " + path + '\n'};
+        }
+        if (text != w.source) {
+            w.source = std::move(text);
+            w.replies.clear();
+        }
+    }
+    auto it = w.replies.find(mode);
+    if (it != w.replies.end()) return it->second;
+    return w.replies[mode] = mode & EXECUTE ? runModule(w.source, mode) : compileModule(w.source, mode);
+}
+
+Reply Server::stats() const {
+    std::ostringstream os;
+    os << "uptime: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() << " s\n";
+    for (int k = 0; k < OTHER; ++k) os << KIND_NAMES[k] << ": " << latency[k].summary() << '\n';
+    os << "files: " << files.size() << (inotify >= 0 ? " (watched)" : " (not watched, read on every request)")
+       << '\n'
+       << "refreshes: " << refreshes << '\n'
+       << "chunks: " << chunks.size() << " in memory, " << (chunks.bytes() + 1023) / 1024 << " KB of "
+       << (opt.memory_limit >> 20) << " MB, " << chunk_hits << " hits, " << chunk_misses << " misses\n";
+    return {true, os.str()};
+}
+
+const Reply& Server::handle(std::string_view line, Kind& kind) {
+    kind = OTHER;
+    auto word = [&] {
+        size_t begin = line.find_first_not_of(' ');
+        if (begin == std::string_view::npos) begin = line.size();
+        size_t end = std::min(line.find(' ', begin), line.size());
+        std::string_view w = line.substr(begin, end - begin);
+        line.remove_prefix(end);
+        return w;
+    };
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    std::string_view command = word();
+    if (command == "stats") {
+        kind = STATS;
+        return other = stats();
+    }
+    if (command == "shutdown") {
+        stopping = true;
+        return other = {true, ""};
+    }
+    if (command != "compile" && command != "run") return other = {false, "Unknown request: " + std::string(command) + '\n'};
+    kind = command == "run" ? RUN : COMPILE;
+    int mode = FOLD | SWITCHES | CSE | (kind == RUN ? EXECUTE : 0);
+    for (;;) {
+        size_t begin = line.find_first_not_of(' ');
+        if (begin == std::string_view::npos || line.compare(begin, 2, "--") != 0) break;
+        std::string_view option = word();
+        if (option == "--no-fold") mode &= ~FOLD;
+        else if (option == "--no-switch") mode &= ~SWITCHES;
+        else if (option == "--no-cse") mode &= ~CSE;
+        else if (option == "--fast-math") mode |= FAST_MATH;
+        else return other = {false, "Unknown option: " + std::string(option) + '\n'};
+    }
+    size_t begin = line.find_first_not_of(' ');
+    std::string path(begin == std::string_view::npos ? std::string_view() : line.substr(begin));
+    if (path.size() < 5 || path.compare(path.size() - 5, 5, ".volt") != 0)
+        return other = {false, "Il file deve avere estensione .volt\n"};
+    return reply(fs::absolute(path).lexically_normal().string(), mode);
+}
+
+bool Server::answer(int fd, std::string_view line) {
+    auto start = std::chrono::steady_clock::now();
+    Kind kind;
+    const Reply& r = handle(line, kind);
+    bool sent = sendAll(fd, (r.ok ? "ok " : "error ") + std::to_string(r.body.size()) + '\n') && sendAll(fd, r.body);
+    if (kind != OTHER)
+        latency[kind].add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return sent;
+}
+
+void Server::onChanges() {
+    alignas(inotify_event) char buf[4096];
+    std::vector<std::string> changed;
+    ssize_t n;
+    while ((n = ::read(inotify, buf, sizeof buf)) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+                // Events were lost, or a directory is no longer watched.
+                if (ev->mask & IN_IGNORED) watch_dirs.erase(ev->wd);
+                for (auto& f : files) {
+                    f.second.fresh = false;
+                    changed.push_back(f.first);
+                }
+                continue;
+            }
+            auto dir = watch_dirs.find(ev->wd);
+            if (dir == watch_dirs.end() || ev->len == 0) continue;
+            std::string path = (fs::path(dir->second) / ev->name).string();
+            auto f = files.find(path);
+            if (f == files.end()) continue;
+            f->second.fresh = false;
+            // Compile again once the writer is done; a request before that
+            // reads the file anyway.
+            if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) changed.push_back(path);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (const std::string& path : changed) {
+        auto f = files.find(path);
+        if (f == files.end() || f->second.fresh) continue;
+        std::vector<int> modes;
+        for (const auto& r : f->second.replies) modes.push_back(r.first);
+        for (int mode : modes) reply(path, mode);
+        ++refreshes;
+    }
+}
+
+} // namespace
+
+int serve(const ServeOptions& opt) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (opt.socket.size() >= sizeof addr.sun_path) {
+        std::cerr << "Error: socket path too long: " << opt.socket << std::endl;
+        return 1;
+    }
+    std::memcpy(addr.sun_path, opt.socket.c_str(), opt.socket.size() + 1);
+    const sockaddr* address = reinterpret_cast<const sockaddr*>(&addr);
+
+    // A socket file nobody accepts on is left from a server that died.
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener >= 0 && ::connect(listener, address, sizeof addr) == 0) {
+        std::cerr << "Error: a server is already listening on " << opt.socket << std::endl;
+        ::close(listener);
+        return 1;
+    }
+    if (listener >= 0) ::close(listener);
+    ::unlink(opt.socket.c_str());
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, address, sizeof addr) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: could not listen on " << opt.socket << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) ::close(listener);
+        return 1;
+    }
+
+    struct sigaction sa{};
+    sa.sa_handler = onSignal;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Server server(opt);
+    if (server.watchFd() < 0) std::cerr << "Warning: inotify unavailable; files are read on every request" << std::endl;
+    std::cerr << "Serving on " << opt.socket << std::endl;
+
+    struct Client {
+        int fd;
+        std::string buffer;
+    };
+    std::vector<Client> clients;
+    int status = 0;
+    while (!stop_requested && !server.stopping) {
+        std::vector<pollfd> fds = {{listener, POLLIN, 0}, {server.watchFd(), POLLIN, 0}};
+        for (const Client& c : clients) fds.push_back({c.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: poll: " << std::strerror(errno) << std::endl;
+            status = 1;
+            break;
+        }
+        // Changes first, so a request sent right after a save sees it.
+        if (fds[1].revents & POLLIN) server.onChanges();
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (!fds[i + 2].revents) continue;
+            Client& c = clients[i];
+            char buf[4096];
+            ssize_t n = ::recv(c.fd, buf, sizeof buf, 0);
+            bool open = n > 0;
+            if (open) c.buffer.append(buf, static_cast<size_t>(n));
+            for (size_t nl; open && !server.stopping && (nl = c.buffer.find('\n')) != std::string::npos;) {
+                std::string line = c.buffer.substr(0, nl);
+                c.buffer.erase(0, nl + 1);
+                open = server.answer(c.fd, line);
+            }
+            if (!open || c.buffer.size() > MAX_REQUEST) {
+                ::close(c.fd);
+                c.fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd < 0; }),
+                      clients.end());
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) clients.push_back({fd, {}});
+        }
+    }
+    for (const Client& c : clients) ::close(c.fd);
+    ::close(listener);
+    ::unlink(opt.socket.c_str());
+    return status;
+}
+
+int serveRequest(const std::string& socket, const std::vector<std::string>& words) {
+    std::string line;
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string w = words[i];
+        if (i > 0 && w.compare(0, 2, "--") != 0) w = fs::absolute(w).lexically_normal().string();
+        line += (i ? " " : "") + w;
+    }
+    line += '\n';
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket.size() >= sizeof addr.sun_path) {
+        std::cerr << "Error: socket path too long: " << socket << std::endl;
+        return 1;
+    }
+    std::memcpy(addr.sun_path, socket.c_str(), socket.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) != 0) {
+        std::cerr << "Error: could not connect to " << socket << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
+    std::string data;
+    size_t header = std::string::npos, size = 0;
+    bool sent = sendAll(fd, line);
+    char buf[65536];
+    while (sent && (header == std::string::npos || data.size() < header + 1 + size)) {
+        ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data.append(buf, static_cast<size_t>(n));
+        if (header == std::string::npos && (header = data.find('\n')) != std::string::npos)
+            size = std::strtoull(data.c_str() + data.find(' ') + 1, nullptr, 10);
+    }
+    ::close(fd);
+    if (header == std::string::npos || data.size() < header + 1 + size) {
+        std::cerr << "Error: no reply from " << socket << std::endl;
+        return 1;
+    }
+    bool ok = data.compare(0, 3, "ok ") == 0;
+    (ok ? std::cout : std::cerr).write(data.data() + header + 1, static_cast<std::streamsize>(size));
+    return ok ? 0 : 1;
+}
+
+#else // !VOLT_SERVE
+
+int serve(const ServeOptions&) {
+    std::cerr << "Error: --serve is only available on Linux" << std::endl;
+    return 1;
+}
+
+int serveRequest(const std::string&, const std::vector<std::string>&) {
+    std::cerr << "Error: --connect is only available on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ---- Compile server (voltage --serve) -------------------------------------
+//
+// A long-running process that answers compile requests over a Unix domain
+// socket, so editors and test runners do not pay for process start-up and a
+// full compile on every call.
+//
+// Requests are single lines of words; paths should be absolute (relative
+// ones are resolved against the server's working directory):
+//   compile [--no-fold] [--no-switch] [--no-cse] [--fast-math] <file.volt>
+//   run [--no-fold] <file.volt>      as voltage --run
+//   stats                            latency percentiles and state
+//   shutdown
+// Each reply is a line "ok <bytes>" or "error <bytes>" followed by that many
+// bytes: the IR or output, or the diagnostics. A connection may send any
+// number of requests.
+//
+// The server keeps the source of every file it has compiled and the IR of
+// each chunk (as in --cache, but in memory), and watches the files'
+// directories with inotify. When a file changes it is read and compiled
+// again at once, for the options it was last requested with: the whole file
+// is lexed to find the edited statements, and only the chunks containing
+// them are parsed, checked and lowered again. A request for an unchanged
+// file is answered from the reply kept for it.
+
+struct ServeOptions {
+    std::string socket;
+    unsigned threads = 0;               // for recompiling chunks; 0 = one per hardware thread
+    uint64_t memory_limit = 256u << 20; // bytes of chunk IR kept, least recently used evicted first
+};
+
+// Serves until a shutdown request, SIGINT or SIGTERM; returns the exit status.
+int serve(const ServeOptions& opt);
+
+// Sends one request (its words, e.g. {"compile", "a.volt"}) to the server
+// at `socket`, writes the reply body to stdout (or stderr for an error) and
+// returns the exit status. Words other than the first that are not options
+// are made absolute first.
+int serveRequest(const std::string& socket, const std::vector<std::string>& words);
@@ -0,0 +1,127 @@
+#include "split.h"
+#include <algorithm>
+#include "fold.h"
+#include "irwriter.h"
+#include "pool.h"
+#include "sema.h"
+
+bool parseChunk(Chunk& c) {
+    try {
+        c.ast = Parser::parseProgram(c.text);
+    } catch (const ParseError&) {
+        return false;
+    }
+    return true;
+}
+
+void inheritVariables(Chunk& c, const VarTypes& globals) {
+    c.inherited.clear();
+    if (globals.empty()) return;
+    for (uint32_t sym = 0; sym < c.ast.strings.size(); ++sym) {
+        auto it = globals.find(c.ast.str(sym));
+        if (it != globals.end()) c.inherited.push_back({sym, it->second.type, it->second.length});
+    }
+}
+
+void declareVariables(const Chunk& c, VarTypes& globals) {
+    for (uint32_t root : c.ast.roots) {
+        const Node& decl = c.ast[root];
+        if (decl.kind == NodeKind::VAR_DECL) globals.emplace(c.ast.str(decl.a), VarType{decl.type, decl.flags});
+    }
+}
+
+bool lowerChunk(Chunk& c, bool fold, const CodeGenOptions& gen_opts) {
+    Context ctx;
+    ctx.resize(c.ast.strings.size());
+    for (const CodeGen::Inherited& in : c.inherited) {
+        ctx.declared[in.sym] = true;
+        ctx.var_types[in.sym] = in.type;
+        ctx.lengths[in.sym] = in.length;
+    }
+    if (!Sema(c.ast, ctx).run()) return false;
+    if (fold) Folder(c.ast).run();
+    IrWriter ir;
+    CodeGen gen(c.ast, ctx, ir, gen_opts);
+    gen.emitChunk(c.out.name, c.inherited);
+    c.out.ir = ir.takeText();
+    c.out.last_block = gen.lastBlock();
+    for (const CodeGen::Inherited& in : gen.usedInherited())
+        c.out.used.push_back({std::string(c.ast.str(in.sym)), in.type, in.length, {}});
+    for (const CodeGen::Export& e : gen.exports())
+        c.out.exports.push_back({std::string(c.ast.str(e.sym)), e.type, e.length, e.value});
+    c.out.instructions = gen.instructionCount();
+    c.out.removed = gen.removedInstructions();
+    c.out.temporaries = static_cast<uint32_t>(ctx.temp_index);
+    return true;
+}
+
+void stitchChunks(std::vector<ChunkIr>& chunks, SplitModule& module) {
+    std::unordered_map<std::string, std::string> current; // variable -> operand text
+    module.parts.clear();
+    module.chunks = chunks.size();
+    module.parts.push_back("define i32 @main() nounwind norecurse {\n");
+    for (size_t k = 0; k < chunks.size(); ++k) {
+        ChunkIr& c = chunks[k];
+        std::string head = c.name + ":\n";
+        for (const ChunkIr::Var& in : c.used)
+            head += "  %" + in.name + '.' + c.name + ".in = phi " + voltTypeToLLVM(in.type, in.length) + " [ " +
+                    current[in.name] + ", %" + chunks[k - 1].last_block + " ]\n";
+        module.parts.push_back(std::move(head));
+        module.parts.push_back(std::move(c.ir));
+        module.parts.push_back(k + 1 < chunks.size() ? "  br label %" + chunks[k + 1].name + '\n'
+                                                     : std::string("  ret i32 0\n}\n"));
+        for (const ChunkIr::Var& e : c.exports) current[e.name] = e.value;
+        module.instructions += static_cast<uint32_t>(c.used.size()) + c.instructions + 1;
+        module.removed += c.removed;
+        module.temporaries += c.temporaries;
+    }
+}
+
+bool compileSplit(std::string_view source, unsigned chunks, bool fold, const CodeGenOptions& gen,
+                  WorkStealingPool& pool, Profiler& prof, SplitModule& module) {
+    std::vector<Chunk> parts;
+    {
+        Profiler::Scope phase(prof, "split");
+        size_t target = chunks > 1 ? source.size() / chunks : 0;
+        size_t start = 0;
+        for (size_t cut : Parser::splitPoints(source, target)) {
+            parts.emplace_back();
+            parts.back().text = source.substr(start, cut - start);
+            start = cut;
+        }
+        parts.emplace_back();
+        parts.back().text = source.substr(start);
+        for (size_t i = 0; i < parts.size(); ++i) parts[i].out.name = 'c' + std::to_string(i);
+    }
+
+    std::vector<char> ok(parts.size(), 1);
+    auto allOk = [&] { return std::find(ok.begin(), ok.end(), 0) == ok.end(); };
+    {
+        Profiler::Scope phase(prof, "parse");
+        pool.parallelFor(parts.size(), [&](size_t i, unsigned) { ok[i] = parseChunk(parts[i]); });
+    }
+    if (!allOk()) return false;
+    {
+        Profiler::Scope phase(prof, "fixup");
+        VarTypes globals;
+        for (Chunk& c : parts) {
+            inheritVariables(c, globals);
+            declareVariables(c, globals);
+        }
+    }
+    {
+        Profiler::Scope phase(prof, "codegen");
+        pool.parallelFor(parts.size(), [&](size_t i, unsigned) { ok[i] = lowerChunk(parts[i], fold, gen); });
+    }
+    if (!allOk()) return false;
+
+    Profiler::Scope phase(prof, "stitch");
+    std::vector<ChunkIr> irs;
+    irs.reserve(parts.size());
+    for (Chunk& c : parts) {
+        module.ast_nodes += c.ast.nodes.size();
+        irs.push_back(std::move(c.out));
+    }
+    stitchChunks(irs, module);
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "codegen.h"
+#include "parser.h"
+#include "stats.h"
+
+class WorkStealingPool;
+
+// ---- Chunked compilation ------------------------------------------------
+//
+// A module can be compiled as a sequence of chunks of top-level statements,
+// each parsed, checked and lowered on its own (CodeGen::emitChunk) and then
+// stitched into one @main. Chunk N's names all start with its name, and its
+// entry block reads the current values of the top-level variables declared
+// in earlier chunks through one-input phis written at stitch time.
+
+// Type of a top-level variable: element type and array length (0 for a
+// scalar).
+struct VarType {
+    VoltType type;
+    uint8_t length;
+};
+
+// Top-level variables declared so far, with their types.
+using VarTypes = std::unordered_map<std::string_view, VarType>;
+
+// The IR of one chunk and what connects it to its neighbours. Variables are
+// referred to by name, so it stands on its own without the chunk's Ast and
+// can be kept in the cache (see cache.h).
+struct ChunkIr {
+    struct Var {
+        std::string name;
+        VoltType type;
+        uint8_t length;
+        std::string value; // exports: operand text of the final value
+    };
+    std::string name;         // entry block, prefix of the chunk's names
+    std::vector<Var> used;    // inherited variables the chunk reads
+    std::vector<Var> exports; // top-level variables it declared or assigned
+    std::string ir, last_block;
+    uint32_t instructions = 0;
+    uint32_t removed = 0; // by value numbering
+    uint32_t temporaries = 0;
+};
+
+// A chunk being compiled. `text` is a view into the source, which must
+// outlive it.
+struct Chunk {
+    std::string_view text;
+    Ast ast;
+    std::vector<CodeGen::Inherited> inherited;
+    ChunkIr out;
+};
+
+// Returns false on a parse error.
+bool parseChunk(Chunk& c);
+// The chunk's names that are top-level variables of earlier chunks.
+void inheritVariables(Chunk& c, const VarTypes& globals);
+// Adds the chunk's top-level declarations; the first one of a name wins
+// (Sema rejects a later one with another type).
+void declareVariables(const Chunk& c, VarTypes& globals);
+// Sema, folding and code generation into c.out (whose name must be set).
+// Returns false on a type error.
+bool lowerChunk(Chunk& c, bool fold, const CodeGenOptions& gen);
+
+// The body of @main in order, ready to be written after the module header.
+struct SplitModule {
+    std::vector<std::string> parts;
+    size_t chunks = 0;
+    size_t ast_nodes = 0;
+    uint32_t instructions = 0;
+    uint32_t removed = 0;
+    uint64_t temporaries = 0;
+};
+
+// Joins chunks into @main: the define line, then for each chunk its entry
+// label, its phis, its IR and a branch to the next one (ret in the last).
+// The IR texts are moved into `module`.
+void stitchChunks(std::vector<ChunkIr>& chunks, SplitModule& module);
+
+// Compiles one source as `chunks` pieces cut at top-level statement
+// boundaries (Parser::splitPoints), each piece on its own pool task.
+// Variables declared at the top level of an earlier piece are resolved in a
+// sequential fix-up between parsing and checking.
+//
+// Returns false when any piece has a parse or type error. Nothing has been
+// written then, and the caller compiles the source sequentially, which
+// reports the diagnostics against whole-file line numbers.
+bool compileSplit(std::string_view source, unsigned chunks, bool fold, const CodeGenOptions& gen,
+                  WorkStealingPool& pool, Profiler& prof, SplitModule& module);
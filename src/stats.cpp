@@ -0,0 +1,132 @@
+#include "stats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <ctime>
+
+namespace {
+thread_local uint64_t t_allocs = 0;
+thread_local uint64_t t_bytes = 0;
+} // namespace
+
+void* operator new(size_t n) {
+    ++t_allocs;
+    t_bytes += n;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+HeapCount heapCount() { return {t_allocs, t_bytes}; }
+
+namespace {
+
+// CPU time of the calling thread; files compiled in parallel must not
+// see each other's time.
+double threadCpuSeconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+} // namespace
+
+Profiler::Scope::Scope(Profiler& p, const char* phase, bool extra_pass)
+    : prof(p.enabled ? &p : nullptr), name(phase), extra(extra_pass) {
+    if (!prof) return;
+    heap0 = heapCount();
+    cpu0 = threadCpuSeconds();
+    wall0 = std::chrono::steady_clock::now();
+}
+
+Profiler::Scope::~Scope() {
+    if (!prof) return;
+    auto wall1 = std::chrono::steady_clock::now();
+    double cpu1 = threadCpuSeconds();
+    HeapCount heap1 = heapCount();
+    using Seconds = std::chrono::duration<double>;
+    prof->list.push_back({name, Seconds(wall0 - prof->origin).count(), Seconds(wall1 - wall0).count(),
+                          cpu1 - cpu0, heap1.allocs - heap0.allocs,
+                          heap1.bytes - heap0.bytes, extra});
+}
+
+void Profiler::print(std::ostream& os, bool times, bool heap) const {
+    char line[160];
+    auto row = [&](const char* name, double wall, double cpu, uint64_t allocs, uint64_t bytes) {
+        int n = std::snprintf(line, sizeof line, "  %-12s", name);
+        if (times) n += std::snprintf(line + n, sizeof line - n, " %10.3f %10.3f", wall * 1e3, cpu * 1e3);
+        if (heap)
+            std::snprintf(line + n, sizeof line - n, " %10llu %12llu", static_cast<unsigned long long>(allocs),
+                          static_cast<unsigned long long>(bytes));
+        os << line << '\n';
+    };
+    int n = std::snprintf(line, sizeof line, "  %-12s", "phase");
+    if (times) n += std::snprintf(line + n, sizeof line - n, " %10s %10s", "wall ms", "cpu ms");
+    if (heap) std::snprintf(line + n, sizeof line - n, " %10s %12s", "allocs", "bytes");
+    os << line << '\n';
+
+    Phase total{"total", 0, 0, 0, 0, 0, false};
+    bool any_extra = false;
+    for (const Phase& p : list) {
+        std::string name = p.extra ? std::string(p.name) + "*" : p.name;
+        row(name.c_str(), p.wall, p.cpu, p.allocs, p.bytes);
+        any_extra = any_extra || p.extra;
+        if (p.extra) continue;
+        total.wall += p.wall;
+        total.cpu += p.cpu;
+        total.allocs += p.allocs;
+        total.bytes += p.bytes;
+    }
+    row(total.name, total.wall, total.cpu, total.allocs, total.bytes);
+    if (any_extra) os << "  * separate measurement pass, not part of the total\n";
+}
+
+namespace {
+
+std::string jsonEscape(const std::string& s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\') r += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof buf, "\\u%04x", c);
+            r += buf;
+        } else {
+            r += c;
+        }
+    }
+    return r;
+}
+
+} // namespace
+
+void Profiler::writeTrace(const std::string& path, const std::vector<const Profiler*>& profilers) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("Could not open trace file " + path);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char ev[320];
+    bool first = true;
+    for (const Profiler* prof : profilers) {
+        std::string file = jsonEscape(prof->source);
+        for (const Phase& p : prof->list) {
+            std::snprintf(ev, sizeof ev,
+                          "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                          "\"dur\":%.3f,\"args\":{\"cpu_ms\":%.3f,\"allocs\":%llu,\"bytes\":%llu,\"file\":\"",
+                          first ? "" : ",", p.name, p.extra ? "measurement" : "phase", prof->tid + 1,
+                          p.start * 1e6, p.wall * 1e6, p.cpu * 1e3, static_cast<unsigned long long>(p.allocs),
+                          static_cast<unsigned long long>(p.bytes));
+            f << ev << file << "\"}}";
+            first = false;
+        }
+    }
+    f << "\n]}\n";
+    if (!f) throw std::runtime_error("Could not write trace file " + path);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Heap allocations made by the calling thread so far. The program's global
+// operator new keeps these counters, at the cost of two thread-local
+// increments per allocation.
+struct HeapCount {
+    uint64_t allocs;
+    uint64_t bytes;
+};
+HeapCount heapCount();
+
+// Wall-clock time, CPU time and heap traffic per compiler phase, for
+// --time-report, --stats and --trace. A phase is measured by a Scope that
+// lives as long as the phase; while the profiler is disabled a Scope only
+// tests one flag.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase {
+        const char* name;
+        double start; // wall seconds since the trace origin
+        double wall;
+        double cpu;   // CPU seconds of the thread that ran the phase
+        uint64_t allocs, bytes;
+        bool extra; // measurement-only pass, left out of the totals
+    };
+
+    class Scope {
+        Profiler* prof; // null when disabled
+        const char* name;
+        bool extra;
+        Clock::time_point wall0;
+        double cpu0 = 0;
+        HeapCount heap0{0, 0};
+    public:
+        Scope(Profiler& p, const char* phase, bool extra_pass = false);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // `origin` is time zero of the trace; profilers of files compiled in
+    // one run share it.
+    explicit Profiler(bool on, Clock::time_point origin = Clock::now()) : enabled(on), origin(origin) {}
+    bool isEnabled() const { return enabled; }
+    // Input file and worker thread, recorded in the trace.
+    void setSource(const std::string& file, unsigned thread) {
+        source = file;
+        tid = thread;
+    }
+    const std::vector<Phase>& phases() const { return list; }
+
+    // Table of the phases with the requested columns, and a total row.
+    void print(std::ostream& os, bool times, bool heap) const;
+    // Writes the phases of all profilers as complete events in the Chrome
+    // trace format (chrome://tracing, Perfetto), one track per worker.
+    // Throws std::runtime_error on I/O errors.
+    static void writeTrace(const std::string& path, const std::vector<const Profiler*>& profilers);
+
+private:
+    bool enabled;
+    Clock::time_point origin;
+    std::string source;
+    unsigned tid = 0;
+    std::vector<Phase> list;
+};
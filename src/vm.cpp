@@ -0,0 +1,397 @@
+#include "vm.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include "fold.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VOLT_THREADED_DISPATCH 1
+#endif
+
+namespace {
+
+// Temporaries are numbered from TEMP_BIT while compiling and moved after
+// the fixed registers (variables and constants) once their count is known.
+constexpr uint32_t TEMP_BIT = 0x80000000u;
+constexpr uint32_t NO_REG = UINT32_MAX;
+constexpr const char* ARRAYS_UNSUPPORTED = "Arrays are only supported when compiling to LLVM IR";
+constexpr const char* TYPES_UNSUPPORTED = "Integer types other than int are only supported when compiling to LLVM IR";
+
+class BytecodeCompiler {
+    const Ast& ast;
+    Bytecode bc;
+    std::vector<uint32_t> var_regs;                       // symbol id -> register, NO_REG if none yet
+    std::unordered_map<uint64_t, uint32_t> const_regs[3]; // per type: bits -> register
+    uint32_t fixed = 0;    // variables and constants
+    uint32_t temp_top = 0; // temporaries in use by the current statement
+    uint32_t temp_max = 0;
+    bool reuse_temps;
+    // Expression walk, see expr(): a node, the operands it has emitted, and
+    // for && / || its result register and the jump over its right operand.
+    struct Frame {
+        uint32_t n;
+        uint8_t step;
+        uint32_t dst, jump;
+    };
+    std::vector<Frame> frames;
+    std::vector<uint32_t> regs; // registers of the operands emitted by the walk
+
+    void releaseTemps() { if (reuse_temps) temp_top = 0; }
+
+    uint32_t newTemp() {
+        uint32_t t = temp_top++;
+        if (temp_top > temp_max) temp_max = temp_top;
+        return TEMP_BIT | t;
+    }
+    uint32_t newFixed(Reg init) {
+        bc.initial.push_back(init);
+        return fixed++;
+    }
+    uint32_t emit(Op op, uint32_t dst, uint32_t a, uint32_t b = 0) {
+        bc.code.push_back(Instr{op, 0, dst, a, b});
+        return static_cast<uint32_t>(bc.code.size() - 1);
+    }
+    uint32_t here() const { return static_cast<uint32_t>(bc.code.size()); }
+
+    uint32_t varReg(uint32_t name) {
+        if (var_regs[name] == NO_REG) var_regs[name] = newFixed(Reg{0});
+        return var_regs[name];
+    }
+
+    uint32_t constReg(const Node& c) {
+        auto& regs = const_regs[static_cast<int>(c.type)];
+        uint64_t key = (static_cast<uint64_t>(c.b) << 32) | c.a;
+        auto it = regs.find(key);
+        if (it != regs.end()) return it->second;
+        Reg init{0};
+        if (c.type == VoltType::INT) init.i = constInt(c);
+        else if (c.type == VoltType::FLOAT) init.f = constFloat(c);
+        else init.d = constDouble(c);
+        uint32_t r = newFixed(init);
+        regs.emplace(key, r);
+        return r;
+    }
+
+    // Int register holding (value != 0) for a value of node n's type.
+    uint32_t test(uint32_t n, uint32_t reg, uint32_t dst) {
+        VoltType t = ast[n].type;
+        emit(t == VoltType::INT ? Op::TEST_I32 : t == VoltType::FLOAT ? Op::TEST_F32 : Op::TEST_F64, dst, reg);
+        return dst;
+    }
+
+    uint32_t popReg() {
+        uint32_t r = regs.back();
+        regs.pop_back();
+        return r;
+    }
+    uint32_t expr(uint32_t root);
+    void statement(uint32_t n);
+public:
+    BytecodeCompiler(const Ast& a, bool reuse) : ast(a), var_regs(a.strings.size(), NO_REG), reuse_temps(reuse) {}
+    Bytecode compile();
+};
+
+Op arithOp(TokenType op, VoltType t) {
+    static const Op table[3][5] = {
+        {Op::ADD_I32, Op::SUB_I32, Op::MUL_I32, Op::DIV_I32, Op::MOD_I32},
+        {Op::ADD_F32, Op::SUB_F32, Op::MUL_F32, Op::DIV_F32, Op::MOD_F32},
+        {Op::ADD_F64, Op::SUB_F64, Op::MUL_F64, Op::DIV_F64, Op::MOD_F64},
+    };
+    if (op == SHL) return Op::SHL_I32;
+    return table[static_cast<int>(t)][op - PLUS];
+}
+
+Op compareOp(TokenType op, VoltType t) {
+    static const Op table[3][6] = {
+        {Op::GT_I32, Op::LT_I32, Op::GTE_I32, Op::LTE_I32, Op::NE_I32, Op::EQ_I32},
+        {Op::GT_F32, Op::LT_F32, Op::GTE_F32, Op::LTE_F32, Op::NE_F32, Op::EQ_F32},
+        {Op::GT_F64, Op::LT_F64, Op::GTE_F64, Op::LTE_F64, Op::NE_F64, Op::EQ_F64},
+    };
+    return table[static_cast<int>(t)][op - GT];
+}
+
+// Post-order walk with an explicit stack, so long operator chains cannot
+// overflow the native stack: each frame runs one step of its node, and the
+// registers of its operands are on `regs`.
+uint32_t BytecodeCompiler::expr(uint32_t root) {
+    size_t base = frames.size();
+    frames.push_back({root, 0, 0, 0});
+    while (frames.size() > base) {
+        Frame f = frames.back();
+        frames.pop_back();
+        const Node& node = ast[f.n];
+        switch (node.kind) {
+        case NodeKind::NUMBER:
+            regs.push_back(constReg(literalConst(ast, node)));
+            continue;
+        case NodeKind::CONST:
+            regs.push_back(constReg(node));
+            continue;
+        case NodeKind::VARIABLE:
+            regs.push_back(varReg(node.a));
+            continue;
+        case NodeKind::CONVERT: {
+            if (f.step == 0) {
+                frames.push_back({f.n, 1, 0, 0});
+                frames.push_back({node.a, 0, 0, 0});
+                continue;
+            }
+            uint32_t src = popReg();
+            VoltType from = ast[node.a].type;
+            Op op = from == VoltType::FLOAT ? Op::F32_TO_F64 : node.type == VoltType::FLOAT ? Op::I32_TO_F32 : Op::I32_TO_F64;
+            uint32_t dst = newTemp();
+            emit(op, dst, src);
+            regs.push_back(dst);
+            continue;
+        }
+        case NodeKind::LOGICOP:
+        case NodeKind::BINOP: {
+            if (node.op == AND || node.op == OR) {
+                // Short-circuit: the right operand only runs when it decides the result.
+                if (f.step == 0) {
+                    frames.push_back({f.n, 1, newTemp(), 0});
+                    frames.push_back({node.a, 0, 0, 0});
+                } else if (f.step == 1) {
+                    test(node.a, popReg(), f.dst);
+                    uint32_t jump = emit(node.op == AND ? Op::JZ : Op::JNZ, 0, f.dst, 0);
+                    frames.push_back({f.n, 2, f.dst, jump});
+                    frames.push_back({node.b, 0, 0, 0});
+                } else {
+                    test(node.b, popReg(), f.dst);
+                    bc.code[f.jump].b = here();
+                    regs.push_back(f.dst);
+                }
+                continue;
+            }
+            if (f.step == 0) {
+                frames.push_back({f.n, 1, 0, 0});
+                frames.push_back({node.b, 0, 0, 0});
+                frames.push_back({node.a, 0, 0, 0});
+                continue;
+            }
+            uint32_t r = popReg();
+            uint32_t l = popReg();
+            uint32_t dst = newTemp();
+            if (node.kind == NodeKind::LOGICOP)
+                emit(compareOp(static_cast<TokenType>(node.op), ast[node.a].type), dst, l, r);
+            else
+                emit(arithOp(static_cast<TokenType>(node.op), node.type), dst, l, r);
+            regs.push_back(dst);
+            continue;
+        }
+        case NodeKind::ARRAY:
+        case NodeKind::INDEX:
+        case NodeKind::SPLAT:
+            throw std::runtime_error(ARRAYS_UNSUPPORTED);
+        case NodeKind::VAR_DECL:
+        case NodeKind::IF:
+        case NodeKind::FOR:
+            break;
+        }
+        throw std::runtime_error("Statement used as a value");
+    }
+    return popReg();
+}
+
+void BytecodeCompiler::statement(uint32_t n) {
+    const Node node = ast[n];
+    switch (node.kind) {
+    case NodeKind::VAR_DECL: {
+        if (node.flags) throw std::runtime_error(ARRAYS_UNSUPPORTED);
+        // Every value of another integer type comes from such a variable.
+        if (node.type != VoltType::INT && !isFloatType(node.type)) throw std::runtime_error(TYPES_UNSUPPORTED);
+        uint32_t value = expr(node.b);
+        emit(Op::MOV, varReg(node.a), value);
+        break;
+    }
+    case NodeKind::IF: {
+        std::vector<uint32_t> to_end;
+        for (uint32_t i = 0; i < node.b; ++i) {
+            IfBranch br = ast.branch(node, i);
+            uint32_t skip = UINT32_MAX;
+            if (br.cond != NO_NODE) {
+                uint32_t c = expr(br.cond);
+                if (ast[br.cond].type != VoltType::INT) c = test(br.cond, c, newTemp());
+                skip = emit(Op::JZ, 0, c, 0);
+                releaseTemps();
+            }
+            for (uint32_t k = 0; k < br.count; ++k) statement(ast.stmt(br, k));
+            if (i + 1 < node.b) to_end.push_back(emit(Op::JMP, 0, 0));
+            if (skip != UINT32_MAX) bc.code[skip].b = here();
+        }
+        for (uint32_t j : to_end) bc.code[j].a = here();
+        break;
+    }
+    case NodeKind::FOR: {
+        // The end is computed once, into a register of its own.
+        ForLoop loop = ast.loop(node);
+        uint32_t i = varReg(loop.var);
+        emit(Op::MOV, i, expr(loop.from));
+        uint32_t limit = newFixed(Reg{0});
+        emit(Op::MOV, limit, expr(loop.until));
+        releaseTemps();
+        uint32_t top = here();
+        uint32_t more = newTemp();
+        emit(Op::LT_I32, more, i, limit);
+        uint32_t exit = emit(Op::JZ, 0, more, 0);
+        releaseTemps();
+        IfBranch body = loop.body();
+        for (uint32_t k = 0; k < body.count; ++k) statement(ast.stmt(body, k));
+        emit(Op::ADD_I32, i, i, constReg(Node{NodeKind::CONST, 0, VoltType::INT, 0, 1, 0}));
+        emit(Op::JMP, 0, top);
+        bc.code[exit].b = here();
+        break;
+    }
+    default:
+        expr(n);
+    }
+    releaseTemps();
+}
+
+Bytecode BytecodeCompiler::compile() {
+    std::vector<bool> seen(ast.strings.size());
+    for (uint32_t root : ast.roots) {
+        statement(root);
+        const Node& node = ast[root];
+        if (node.kind == NodeKind::VAR_DECL && !seen[node.a]) {
+            seen[node.a] = true;
+            bc.outputs.push_back({node.a, varReg(node.a), node.type});
+        }
+    }
+    emit(Op::HALT, 0, 0);
+
+    auto fix = [this](uint32_t& r) { if (r & TEMP_BIT) r = fixed + (r & ~TEMP_BIT); };
+    for (Instr& in : bc.code) {
+        switch (in.op) {
+        case Op::JMP: break;
+        case Op::JZ: case Op::JNZ: fix(in.a); break;
+        case Op::HALT: break;
+        default: fix(in.dst); fix(in.a); fix(in.b);
+        }
+    }
+    bc.initial.resize(fixed + temp_max, Reg{0});
+    bc.fixed_regs = fixed;
+    return std::move(bc);
+}
+
+} // namespace
+
+Bytecode compileBytecode(const Ast& ast, bool reuse_temps) {
+    return BytecodeCompiler(ast, reuse_temps).compile();
+}
+
+void runBytecode(const Bytecode& bc, std::vector<Reg>& regs) {
+    regs.assign(bc.initial.begin(), bc.initial.end());
+    Reg* r = regs.data();
+    const Instr* code = bc.code.data();
+    const Instr* ip = code;
+
+#ifdef VOLT_THREADED_DISPATCH
+    // Threaded dispatch: every handler jumps straight to the next one.
+    static void* const labels[] = {
+        &&L_ADD_I32, &&L_SUB_I32, &&L_MUL_I32, &&L_DIV_I32, &&L_MOD_I32, &&L_SHL_I32,
+        &&L_ADD_F32, &&L_SUB_F32, &&L_MUL_F32, &&L_DIV_F32, &&L_MOD_F32,
+        &&L_ADD_F64, &&L_SUB_F64, &&L_MUL_F64, &&L_DIV_F64, &&L_MOD_F64,
+        &&L_GT_I32, &&L_LT_I32, &&L_GTE_I32, &&L_LTE_I32, &&L_NE_I32, &&L_EQ_I32,
+        &&L_GT_F32, &&L_LT_F32, &&L_GTE_F32, &&L_LTE_F32, &&L_NE_F32, &&L_EQ_F32,
+        &&L_GT_F64, &&L_LT_F64, &&L_GTE_F64, &&L_LTE_F64, &&L_NE_F64, &&L_EQ_F64,
+        &&L_TEST_F32, &&L_TEST_F64, &&L_TEST_I32,
+        &&L_I32_TO_F32, &&L_I32_TO_F64, &&L_F32_TO_F64,
+        &&L_MOV, &&L_JMP, &&L_JZ, &&L_JNZ, &&L_HALT,
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<size_t>(Op::COUNT),
+                  "dispatch table out of sync with Op");
+#define CASE(name) L_##name:
+#define DISPATCH() goto *labels[static_cast<size_t>(ip->op)]
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define JUMP(target) do { ip = code + (target); DISPATCH(); } while (0)
+    DISPATCH();
+#else
+#define CASE(name) case Op::name:
+#define NEXT() do { ++ip; goto next; } while (0)
+#define JUMP(target) do { ip = code + (target); goto next; } while (0)
+    for (;;) {
+        switch (ip->op) {
+#endif
+
+#define I(x) r[ip->x].i
+#define F(x) r[ip->x].f
+#define D(x) r[ip->x].d
+#define U(x) static_cast<uint32_t>(r[ip->x].i)
+
+    CASE(ADD_I32) I(dst) = static_cast<int32_t>(U(a) + U(b)); NEXT();
+    CASE(SUB_I32) I(dst) = static_cast<int32_t>(U(a) - U(b)); NEXT();
+    CASE(MUL_I32) I(dst) = static_cast<int32_t>(U(a) * U(b)); NEXT();
+    CASE(DIV_I32)
+        if (I(b) == 0) throw std::runtime_error("Division by zero");
+        I(dst) = (I(a) == INT32_MIN && I(b) == -1) ? INT32_MIN : I(a) / I(b);
+        NEXT();
+    CASE(MOD_I32)
+        if (I(b) == 0) throw std::runtime_error("Modulo by zero");
+        I(dst) = (I(a) == INT32_MIN && I(b) == -1) ? 0 : I(a) % I(b);
+        NEXT();
+    CASE(SHL_I32) I(dst) = static_cast<int32_t>(U(a) << (U(b) & 31)); NEXT();
+    CASE(ADD_F32) F(dst) = F(a) + F(b); NEXT();
+    CASE(SUB_F32) F(dst) = F(a) - F(b); NEXT();
+    CASE(MUL_F32) F(dst) = F(a) * F(b); NEXT();
+    CASE(DIV_F32) F(dst) = F(a) / F(b); NEXT();
+    CASE(MOD_F32) F(dst) = std::fmod(F(a), F(b)); NEXT();
+    CASE(ADD_F64) D(dst) = D(a) + D(b); NEXT();
+    CASE(SUB_F64) D(dst) = D(a) - D(b); NEXT();
+    CASE(MUL_F64) D(dst) = D(a) * D(b); NEXT();
+    CASE(DIV_F64) D(dst) = D(a) / D(b); NEXT();
+    CASE(MOD_F64) D(dst) = std::fmod(D(a), D(b)); NEXT();
+    CASE(GT_I32) I(dst) = I(a) > I(b); NEXT();
+    CASE(LT_I32) I(dst) = I(a) < I(b); NEXT();
+    CASE(GTE_I32) I(dst) = I(a) >= I(b); NEXT();
+    CASE(LTE_I32) I(dst) = I(a) <= I(b); NEXT();
+    CASE(NE_I32) I(dst) = I(a) != I(b); NEXT();
+    CASE(EQ_I32) I(dst) = I(a) == I(b); NEXT();
+    CASE(GT_F32) I(dst) = F(a) > F(b); NEXT();
+    CASE(LT_F32) I(dst) = F(a) < F(b); NEXT();
+    CASE(GTE_F32) I(dst) = F(a) >= F(b); NEXT();
+    CASE(LTE_F32) I(dst) = F(a) <= F(b); NEXT();
+    CASE(NE_F32) I(dst) = F(a) != F(b); NEXT();
+    CASE(EQ_F32) I(dst) = F(a) == F(b); NEXT();
+    CASE(GT_F64) I(dst) = D(a) > D(b); NEXT();
+    CASE(LT_F64) I(dst) = D(a) < D(b); NEXT();
+    CASE(GTE_F64) I(dst) = D(a) >= D(b); NEXT();
+    CASE(LTE_F64) I(dst) = D(a) <= D(b); NEXT();
+    CASE(NE_F64) I(dst) = D(a) != D(b); NEXT();
+    CASE(EQ_F64) I(dst) = D(a) == D(b); NEXT();
+    CASE(TEST_F32) I(dst) = F(a) != 0.0f; NEXT();
+    CASE(TEST_F64) I(dst) = D(a) != 0.0; NEXT();
+    CASE(TEST_I32) I(dst) = I(a) != 0; NEXT();
+    CASE(I32_TO_F32) F(dst) = static_cast<float>(I(a)); NEXT();
+    CASE(I32_TO_F64) D(dst) = static_cast<double>(I(a)); NEXT();
+    CASE(F32_TO_F64) D(dst) = static_cast<double>(F(a)); NEXT();
+    CASE(MOV) r[ip->dst] = r[ip->a]; NEXT();
+    CASE(JMP) JUMP(ip->a);
+    CASE(JZ) if (I(a) == 0) JUMP(ip->b); NEXT();
+    CASE(JNZ) if (I(a) != 0) JUMP(ip->b); NEXT();
+    CASE(HALT) return;
+
+#ifndef VOLT_THREADED_DISPATCH
+        case Op::COUNT: return;
+        }
+    next:;
+    }
+#endif
+#undef I
+#undef F
+#undef D
+#undef U
+#undef CASE
+#undef NEXT
+#undef JUMP
+}
+
+std::string formatReg(Reg r, VoltType t) {
+    char buf[64];
+    if (t == VoltType::INT) std::snprintf(buf, sizeof(buf), "%d", r.i);
+    else if (t == VoltType::FLOAT) std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(r.f));
+    else std::snprintf(buf, sizeof(buf), "%.17g", r.d);
+    return buf;
+}
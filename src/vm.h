@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// Register-based bytecode for direct execution (voltage --run).
+//
+// Every instruction reads and writes slots of one preallocated register file.
+// Variables get a fixed register per name, temporaries are reused from
+// statement to statement, and constants live in registers that are filled
+// before execution starts, so no instruction ever loads an immediate.
+
+enum class Op : uint16_t {
+    ADD_I32, SUB_I32, MUL_I32, DIV_I32, MOD_I32, SHL_I32,
+    ADD_F32, SUB_F32, MUL_F32, DIV_F32, MOD_F32,
+    ADD_F64, SUB_F64, MUL_F64, DIV_F64, MOD_F64,
+    GT_I32, LT_I32, GTE_I32, LTE_I32, NE_I32, EQ_I32,
+    GT_F32, LT_F32, GTE_F32, LTE_F32, NE_F32, EQ_F32,
+    GT_F64, LT_F64, GTE_F64, LTE_F64, NE_F64, EQ_F64,
+    TEST_F32, TEST_F64,       // dst = (a != 0.0), int result
+    TEST_I32,                 // dst = (a != 0)
+    I32_TO_F32, I32_TO_F64, F32_TO_F64,
+    MOV,                      // copies the whole 8-byte register
+    JMP,                      // jump to a
+    JZ,                       // jump to b if int register a is zero
+    JNZ,                      // jump to b if int register a is not zero
+    HALT,
+    COUNT
+};
+
+struct Instr {
+    Op op;
+    uint16_t pad = 0;
+    uint32_t dst, a, b;
+};
+
+union Reg {
+    int32_t i;
+    float f;
+    double d;
+};
+
+struct Bytecode {
+    std::vector<Instr> code;
+    std::vector<Reg> initial; // constants preloaded, everything else zero
+    uint32_t fixed_regs = 0;  // variables and constants; temporaries follow
+    struct Output {
+        uint32_t name; // string id
+        uint32_t reg;
+        VoltType type;
+    };
+    std::vector<Output> outputs; // top-level variables, in declaration order
+};
+
+// Lowers a type-checked Ast to bytecode. With reuse_temps == false every
+// temporary gets its own register, which is what the JIT's register
+// allocator works on. Registers hold int, float and double scalars only:
+// throws std::runtime_error if the program uses arrays or other integer
+// types.
+Bytecode compileBytecode(const Ast& ast, bool reuse_temps = true);
+
+// Runs the program on `regs`, which is resized once to the register count.
+// Throws std::runtime_error on division by zero.
+void runBytecode(const Bytecode& bc, std::vector<Reg>& regs);
+
+// Formats a register value of the given type for printing.
+std::string formatReg(Reg r, VoltType t);
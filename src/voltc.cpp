@@ -0,0 +1,169 @@
+#include "voltc.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr char VOLTC_MAGIC[8] = {'\x7f', 'V', 'O', 'L', 'T', 'C', '\n', '\0'};
+constexpr uint32_t VOLTC_FOLDED = 1;
+constexpr uint8_t SYMBOL_DECLARED = 0x80; // else the low bits are the VoltType
+
+// Sections in file order; each starts at a multiple of 8 bytes.
+enum Section { NODES, EXTRA, ROOTS, OFFSETS, STRINGS, TEXT, SYMBOLS, LENGTHS, SECTION_COUNT };
+
+struct SectionRef {
+    uint64_t offset, count;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t node_size;
+    uint32_t reserved;
+    SectionRef sections[SECTION_COUNT];
+};
+
+// A string of the pool: a range of the TEXT section.
+struct StringRef {
+    uint32_t offset, size;
+};
+
+constexpr size_t ELEMENT_SIZE[SECTION_COUNT] = {sizeof(Node),      sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+                                                sizeof(StringRef), sizeof(char),     sizeof(uint8_t),  sizeof(uint8_t)};
+
+static_assert(std::is_trivially_copyable<Node>::value, "Nodes are written as raw bytes");
+static_assert(sizeof(Header) % 8 == 0, "Sections after the header must stay aligned");
+
+uint64_t aligned(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+// Copies a section into a vector with one allocation.
+template <class T>
+void copySection(std::string_view file, const SectionRef& s, std::vector<T>& v) {
+    v.resize(s.count);
+    if (s.count) std::memcpy(v.data(), file.data() + s.offset, s.count * sizeof(T));
+}
+
+Header readHeader(std::string_view file) {
+    Header h;
+    std::memcpy(&h, file.data(), sizeof h);
+    return h;
+}
+
+} // namespace
+
+void writeVoltc(const std::string& path, const Ast& ast, const Context& ctx, bool folded) {
+    std::vector<StringRef> refs(ast.strings.size());
+    std::string text;
+    std::vector<uint8_t> symbols(ast.strings.size()), lengths(ast.strings.size());
+    for (uint32_t id = 0; id < ast.strings.size(); ++id) {
+        std::string_view s = ast.str(id);
+        refs[id] = {static_cast<uint32_t>(text.size()), static_cast<uint32_t>(s.size())};
+        text += s;
+        if (id < ctx.var_types.size()) {
+            symbols[id] = static_cast<uint8_t>(ctx.var_types[id]) | (ctx.declared[id] ? SYMBOL_DECLARED : 0);
+            lengths[id] = ctx.lengths[id];
+        }
+    }
+    if (text.size() > UINT32_MAX) throw std::runtime_error("Module too large for " + path);
+
+    const void* data[SECTION_COUNT] = {ast.nodes.data(), ast.extra.data(), ast.roots.data(), ast.offsets.data(),
+                                       refs.data(),      text.data(),      symbols.data(),   lengths.data()};
+    Header h{};
+    std::memcpy(h.magic, VOLTC_MAGIC, sizeof h.magic);
+    h.version = VOLTC_VERSION;
+    h.flags = folded ? VOLTC_FOLDED : 0;
+    h.node_size = sizeof(Node);
+    h.sections[NODES].count = ast.nodes.size();
+    h.sections[EXTRA].count = ast.extra.size();
+    h.sections[ROOTS].count = ast.roots.size();
+    h.sections[OFFSETS].count = ast.offsets.size();
+    h.sections[STRINGS].count = refs.size();
+    h.sections[TEXT].count = text.size();
+    h.sections[SYMBOLS].count = symbols.size();
+    h.sections[LENGTHS].count = lengths.size();
+    uint64_t offset = sizeof h;
+    for (SectionRef& s : h.sections) {
+        s.offset = offset;
+        offset = aligned(offset + s.count * ELEMENT_SIZE[&s - h.sections]);
+    }
+
+    // Written beside the target and renamed over it, so a reader that has
+    // the old file mapped (even this process, when a .voltc input is written
+    // again in place) keeps seeing it whole.
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f) throw std::runtime_error("Could not open output file " + tmp);
+        f.write(reinterpret_cast<const char*>(&h), sizeof h);
+        const char padding[8] = {};
+        for (int k = 0; k < SECTION_COUNT; ++k) {
+            uint64_t bytes = h.sections[k].count * ELEMENT_SIZE[k];
+            f.write(static_cast<const char*>(data[k]), static_cast<std::streamsize>(bytes));
+            f.write(padding, static_cast<std::streamsize>(aligned(bytes) - bytes));
+        }
+        if (!f) {
+            f.close();
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Could not write " + path);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Could not write " + path);
+    }
+}
+
+VoltcFile::VoltcFile(const std::string& path) : file(path) {
+    std::string_view data = file.text();
+    if (data.size() < sizeof(Header) || std::memcmp(data.data(), VOLTC_MAGIC, sizeof VOLTC_MAGIC) != 0)
+        throw std::runtime_error(path + " is not a .voltc file");
+    Header h = readHeader(data);
+    if (h.version != VOLTC_VERSION || h.node_size != sizeof(Node))
+        throw std::runtime_error(path + " was written by another version of the compiler (format " +
+                                 std::to_string(h.version) + ", expected " + std::to_string(VOLTC_VERSION) + ")");
+    for (int k = 0; k < SECTION_COUNT; ++k) {
+        const SectionRef& s = h.sections[k];
+        if (s.offset % 8 != 0 || s.offset > data.size() || s.count > (data.size() - s.offset) / ELEMENT_SIZE[k])
+            throw std::runtime_error(path + " is truncated or corrupt");
+    }
+    if (h.sections[SYMBOLS].count != h.sections[STRINGS].count ||
+        h.sections[LENGTHS].count != h.sections[STRINGS].count)
+        throw std::runtime_error(path + " is truncated or corrupt");
+}
+
+bool VoltcFile::folded() const { return readHeader(file.text()).flags & VOLTC_FOLDED; }
+
+void VoltcFile::load(Ast& ast, Context& ctx) const {
+    std::string_view data = file.text();
+    Header h = readHeader(data);
+    copySection(data, h.sections[NODES], ast.nodes);
+    copySection(data, h.sections[EXTRA], ast.extra);
+    copySection(data, h.sections[ROOTS], ast.roots);
+    copySection(data, h.sections[OFFSETS], ast.offsets);
+
+    std::vector<StringRef> refs;
+    copySection(data, h.sections[STRINGS], refs);
+    std::string_view text = data.substr(h.sections[TEXT].offset, h.sections[TEXT].count);
+    std::vector<std::string_view> strings(refs.size());
+    for (size_t id = 0; id < refs.size(); ++id) {
+        if (refs[id].offset > text.size() || refs[id].size > text.size() - refs[id].offset)
+            throw std::runtime_error("Corrupt string table in .voltc file");
+        strings[id] = text.substr(refs[id].offset, refs[id].size);
+    }
+    ast.strings.assign(std::move(strings));
+
+    const uint8_t* symbols = reinterpret_cast<const uint8_t*>(data.data() + h.sections[SYMBOLS].offset);
+    const uint8_t* lengths = reinterpret_cast<const uint8_t*>(data.data() + h.sections[LENGTHS].offset);
+    ctx = Context();
+    ctx.resize(refs.size());
+    for (size_t id = 0; id < refs.size(); ++id) {
+        ctx.var_types[id] = static_cast<VoltType>(symbols[id] & ~SYMBOL_DECLARED);
+        ctx.declared[id] = symbols[id] & SYMBOL_DECLARED;
+        ctx.lengths[id] = lengths[id];
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include "parser.h"
+#include "source.h"
+
+// ---- Precompiled modules (.voltc) -----------------------------------------
+//
+// A .voltc file holds a module after Sema: the Ast arrays exactly as they
+// are in memory, its strings and the type (and array length) of every
+// symbol. Everything in it
+// refers to other parts by index or by offset from the start of the file,
+// so it can be mapped anywhere. Loading copies each array in one piece and
+// points the string pool into the mapping; nothing is lexed or parsed.
+//
+// The arrays are stored in the host's byte order. VOLTC_VERSION changes
+// whenever Node or the layout below does, and a file of another version is
+// rejected; the Ast contents themselves are trusted as the compiler wrote
+// them.
+
+constexpr uint32_t VOLTC_VERSION = 3;
+
+// Writes a checked Ast, folded or not. Throws std::runtime_error when the
+// file cannot be written.
+void writeVoltc(const std::string& path, const Ast& ast, const Context& ctx, bool folded);
+
+// A mapped .voltc file. The Ast it loads refers to the mapping, so the
+// file must outlive it.
+class VoltcFile {
+    SourceFile file;
+public:
+    // Maps the file and checks its header and section bounds; throws
+    // std::runtime_error if it is not a valid .voltc file of this version.
+    explicit VoltcFile(const std::string& path);
+    // Whether the Ast was constant-folded before it was written.
+    bool folded() const;
+    // The checked Ast and the Context Sema left behind.
+    void load(Ast& ast, Context& ctx) const;
+};
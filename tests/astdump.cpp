@@ -0,0 +1,136 @@
+// Parser output as text, for the parser's differential test.
+//
+//   astdump <file.volt>...
+//
+// Prints each top-level statement of every file as one S-expression of the
+// tree the parser built (no type checking), or the parse error and its
+// offset. The output names operators and node kinds rather than their
+// numbers, so it only changes when the parsed tree does. It uses nothing
+// newer than the parser before the explicit-stack rewrite, and the expected
+// outputs in tests/parser/ were produced by building it against that parser.
+#include <iostream>
+#include <string>
+#include <vector>
+#include "parser.h"
+#include "source.h"
+
+namespace {
+
+const char* opName(uint8_t op) {
+    switch (op) {
+    case PLUS: return "+";
+    case MINUS: return "-";
+    case MUL: return "*";
+    case DIV: return "/";
+    case MOD: return "%";
+    case AND: return "&&";
+    case OR: return "||";
+    case GT: return "gt";
+    case LT: return "lt";
+    case GTE: return "gte";
+    case LTE: return "lte";
+    case DI: return "di";
+    case EQ: return "eq";
+    case SHL: return "shl";
+    default: return "?";
+    }
+}
+
+const char* typeName(VoltType t) {
+    switch (t) {
+    case VoltType::INT: return "int";
+    case VoltType::FLOAT: return "float";
+    case VoltType::DOUBLE: return "double";
+    default: return "?";
+    }
+}
+
+// Iterative, so the deeply nested expressions of the corpus cannot
+// overflow the stack: each entry is a node to print, or (node == NO_NODE)
+// text to write.
+void dump(const Ast& ast, uint32_t root, std::string& out) {
+    struct Item {
+        uint32_t node;
+        const char* text;
+    };
+    std::vector<Item> work{{root, nullptr}};
+    while (!work.empty()) {
+        Item it = work.back();
+        work.pop_back();
+        if (it.node == NO_NODE) {
+            out += it.text;
+            continue;
+        }
+        const Node& n = ast[it.node];
+        switch (n.kind) {
+        case NodeKind::NUMBER:
+            out += "(num " + std::string(ast.str(n.a)) + ' ' + typeName(n.type) + ')';
+            break;
+        case NodeKind::VARIABLE:
+            out += "(var " + std::string(ast.str(n.a)) + ')';
+            break;
+        case NodeKind::BINOP:
+        case NodeKind::LOGICOP:
+            out += '(';
+            out += opName(n.op);
+            out += ' ';
+            work.push_back({NO_NODE, ")"});
+            work.push_back({n.b, nullptr});
+            work.push_back({NO_NODE, " "});
+            work.push_back({n.a, nullptr});
+            break;
+        case NodeKind::VAR_DECL:
+            out += "(what " + std::string(ast.str(n.a)) + ' ' + typeName(n.type) + ' ';
+            work.push_back({NO_NODE, ")"});
+            work.push_back({n.b, nullptr});
+            break;
+        case NodeKind::IF: {
+            out += "(if";
+            work.push_back({NO_NODE, ")"});
+            for (uint32_t i = n.b; i-- > 0;) {
+                IfBranch br = ast.branch(n, i);
+                work.push_back({NO_NODE, ")"});
+                for (uint32_t k = br.count; k-- > 0;) {
+                    work.push_back({ast.stmt(br, k), nullptr});
+                    work.push_back({NO_NODE, " "});
+                }
+                if (br.cond != NO_NODE) {
+                    work.push_back({br.cond, nullptr});
+                    work.push_back({NO_NODE, " (when "});
+                } else {
+                    work.push_back({NO_NODE, " (else"});
+                }
+            }
+            break;
+        }
+        default:
+            out += "(kind " + std::to_string(static_cast<int>(n.kind)) + ')';
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file.volt>...\n";
+        return 2;
+    }
+    for (int i = 1; i < argc; ++i) {
+        try {
+            SourceFile source(argv[i]);
+            Ast ast = Parser::parseProgram(source.text());
+            for (uint32_t root : ast.roots) {
+                std::string line;
+                dump(ast, root, line);
+                std::cout << line << '\n';
+            }
+        } catch (const ParseError& e) {
+            std::cout << "error at " << e.offset << ": " << e.what() << '\n';
+        } catch (const std::exception& e) {
+            std::cerr << argv[i] << ": " << e.what() << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs every program in examples/ on each back end and compares the printed
+# top-level variables: --run (the bytecode VM), --jit on x86-64 hosts, and
+# the LLVM IR path (bin/irprint, executed with lli when it is installed),
+# each with and without constant folding. The IR path also runs with
+# --no-switch, so elseif chains are checked both as a switch or decision
+# tree and as a compare ladder.
+#
+#   tests/backends.sh [DIR]
+set -e
+
+DIR=${1:-examples}
+OUT=tests/out/backends
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+JIT=
+if [ "$(uname -m)" = x86_64 ]; then JIT=1; fi
+LLI=$(command -v lli || true)
+if [ -z "$LLI" ]; then echo "backends: lli not found, the IR path is not checked"; fi
+
+fail=0
+# same <name> <file> <file>: reports a difference between two outputs.
+same() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL $1"
+        diff "$2" "$3" || true
+        fail=1
+    fi
+}
+
+for f in "$DIR"/*.volt; do
+    b=$OUT/$(basename "$f" .volt)
+    for fold in "" --no-fold; do
+        # shellcheck disable=SC2086
+        bin/voltage --run $fold "$f" | sort > "$b.run"
+        if [ -n "$JIT" ]; then
+            # shellcheck disable=SC2086
+            bin/voltage --jit $fold "$f" | sort > "$b.jit"
+            same "$f --jit $fold" "$b.run" "$b.jit"
+        fi
+        if [ -n "$LLI" ]; then
+            for switch in "" --no-switch; do
+                # shellcheck disable=SC2086
+                bin/irprint $fold $switch "$f" > "$b.ll"
+                "$LLI" "$b.ll" | sort > "$b.lli"
+                same "$f lli $fold $switch" "$b.run" "$b.lli"
+            done
+        fi
+    done
+done
+if [ "$fail" = 0 ]; then echo "backends: ok"; fi
+exit "$fail"
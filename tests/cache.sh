@@ -0,0 +1,91 @@
+#!/bin/sh
+# Compiles programs to IR with --cache twice, into an empty cache and then
+# from it. The second run must hit every chunk and write the same IR as the
+# first. The programs in examples/ and tests/ir/ fit in one chunk, so their
+# IR must also match a compile without the cache, once the chunk's name
+# prefix is removed. A generated program of several chunks is then edited
+# in the middle: the warm compile must miss only some chunks and write the
+# same IR as a compile of the edited file into an empty cache.
+#
+#   tests/cache.sh
+set -e
+
+OUT=tests/out/cache
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+OPT=$(command -v opt || true)
+
+fail=0
+# compile <cache> <ll> <stats> [options] <file>: compiles with --cache.
+compile() {
+    c=$1 ll=$2 stats=$3
+    shift 3
+    bin/voltage --cache "$c" --cache-stats "$@" -o "$ll" 2> "$stats"
+}
+
+# same <what> <want> <got>: compares two IR files.
+same() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL $1"
+        diff "$2" "$3" | head -20 || true
+        fail=1
+    fi
+}
+
+# misses <what> <stats> <pattern>: checks the --cache-stats line.
+misses() {
+    if ! grep -q "$3" "$2"; then
+        echo "FAIL $1: $(cat "$2")"
+        fail=1
+    fi
+}
+
+for f in examples/*.volt tests/ir/[!e]*.volt; do
+    b=$(basename "$f" .volt)
+    for fold in "" --no-fold; do
+        o=$OUT/$b$fold
+        rm -rf "$OUT/c"
+        # shellcheck disable=SC2086
+        bin/voltage $fold "$f" -o "$o.ll"
+        # shellcheck disable=SC2086
+        compile "$OUT/c" "$o.cold.ll" "$o.cold.stats" $fold "$f"
+        # shellcheck disable=SC2086
+        compile "$OUT/c" "$o.warm.ll" "$o.warm.stats" $fold "$f"
+        misses "$f $fold warm" "$o.warm.stats" " 0 misses"
+        same "$f $fold warm" "$o.cold.ll" "$o.warm.ll"
+        # The chunk's entry block is cXXXXXXXX and its names carry a
+        # cXXXXXXXX. prefix.
+        sed -E 's/c[0-9a-f]{8}\.//g; s/^c[0-9a-f]{8}:/entry:/; s/%c[0-9a-f]{8}\b/%entry/g' \
+            "$o.cold.ll" > "$o.plain.ll"
+        same "$f $fold without --cache" "$o.ll" "$o.plain.ll"
+    done
+done
+
+bin/voltgen --shape mixed --stmts 3000 --seed 7 -o "$OUT/big.volt"
+# The same program with one declaration added before a top-level statement
+# in the middle.
+awk '!done && NR > 1500 && /^what / { print "what edited: int = 7;"; done = 1 } { print }' \
+    "$OUT/big.volt" > "$OUT/edited.volt"
+for fold in "" --no-fold; do
+    o=$OUT/big$fold
+    rm -rf "$OUT/c" "$OUT/e"
+    # shellcheck disable=SC2086
+    compile "$OUT/c" "$o.cold.ll" "$o.cold.stats" $fold "$OUT/big.volt"
+    # shellcheck disable=SC2086
+    compile "$OUT/c" "$o.warm.ll" "$o.warm.stats" $fold "$OUT/big.volt"
+    misses "big $fold warm" "$o.warm.stats" " 0 misses"
+    same "big $fold warm" "$o.cold.ll" "$o.warm.ll"
+    if [ -n "$OPT" ] && ! "$OPT" -passes=verify -disable-output "$o.cold.ll"; then
+        echo "FAIL big $fold: opt -passes=verify"
+        fail=1
+    fi
+    # shellcheck disable=SC2086
+    compile "$OUT/c" "$o.edited.ll" "$o.edited.stats" $fold "$OUT/edited.volt"
+    misses "edited $fold" "$o.edited.stats" "[1-9][0-9]* hits, [1-9][0-9]* misses"
+    # shellcheck disable=SC2086
+    compile "$OUT/e" "$o.fresh.ll" "$o.fresh.stats" $fold "$OUT/edited.volt"
+    same "edited $fold" "$o.fresh.ll" "$o.edited.ll"
+done
+if [ "$fail" = 0 ]; then echo "cache: ok"; fi
+exit "$fail"
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Compiles and runs expressions far deeper than any native stack would
+# allow a recursive walk: a chain of 300000 '+', a run of 300001 unary
+# minus and chains of 300000 '&&', as a value and as an if condition. Each
+# program runs with --run, with --jit on x86-64 hosts and through LLVM IR
+# (bin/irprint), whose IR is checked with opt and, for the + and minus
+# chains, executed with lli. (lli takes minutes on the && chains' 600000
+# blocks.)
+#
+#   tests/deep.sh
+set -e
+
+OUT=tests/out/deep
+N=300000
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+awk -v n=$N 'BEGIN {
+    printf "what a: int = 1;\nwhat sum: int = a"
+    for (i = 1; i < n; i++) printf " + a"
+    print ";"
+}' > "$OUT/plus.volt"
+printf 'a = 1\nsum = %d\n' $N > "$OUT/plus.want"
+
+awk -v n=$N 'BEGIN {
+    printf "what a: int = 3;\nwhat neg: int = "
+    for (i = 0; i <= n; i++) printf "-"
+    print "a;"
+}' > "$OUT/minus.volt"
+printf 'a = 3\nneg = -3\n' > "$OUT/minus.want"
+
+awk -v n=$N 'BEGIN {
+    printf "what a: int = 1;\nwhat all: int = a"
+    for (i = 1; i < n; i++) printf " && a"
+    print ";"
+    printf "what c: int = 0;\nif a"
+    for (i = 1; i < n; i++) printf " && a"
+    print " then;\n    what c: int = 2;\nendif;"
+}' > "$OUT/and.volt"
+printf 'a = 1\nall = 1\nc = 2\n' > "$OUT/and.want"
+
+JIT=
+if [ "$(uname -m)" = x86_64 ]; then JIT=1; fi
+OPT=$(command -v opt || true)
+LLI=$(command -v lli || true)
+
+fail=0
+# check <name> <file>: compares an output with the expected one.
+check() {
+    if ! sort "$2" | cmp -s "$b.want" -; then
+        echo "FAIL $1"
+        sort "$2" | diff "$b.want" - || true
+        fail=1
+    fi
+}
+
+for p in plus minus and; do
+    b=$OUT/$p
+    bin/voltage --run "$b.volt" > "$b.run" || true
+    check "$p --run" "$b.run"
+    if [ -n "$JIT" ]; then
+        bin/voltage --jit "$b.volt" > "$b.jit" || true
+        check "$p --jit" "$b.jit"
+    fi
+    if ! bin/irprint "$b.volt" > "$b.ll"; then
+        echo "FAIL $p irprint"
+        fail=1
+        continue
+    fi
+    if [ -n "$OPT" ] && ! "$OPT" -passes=verify -disable-output "$b.ll"; then
+        echo "FAIL $p opt -passes=verify"
+        fail=1
+    fi
+    if [ -n "$LLI" ] && [ "$p" != and ]; then
+        "$LLI" "$b.ll" > "$b.lli" || true
+        check "$p lli" "$b.lli"
+    fi
+done
+if [ "$fail" = 0 ]; then echo "deep: ok"; fi
+exit "$fail"
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Runs every program in tests/ir/ through the LLVM IR path, with and
+# without constant folding: bin/irprint, opt -passes=verify and lli. The
+# printed variables must match the .out file next to the program. For a
+# program that does not compile (err_*.volt), the .out file holds the
+# errors instead. These programs use features --run and --jit reject, so
+# tests/backends.sh cannot compare them with the VM.
+#
+#   tests/ir.sh
+set -e
+
+OUT=tests/out/ir
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+OPT=$(command -v opt || true)
+LLI=$(command -v lli || true)
+if [ -z "$LLI" ]; then echo "ir: lli not found, only compile errors are checked"; fi
+
+fail=0
+for f in tests/ir/*.volt; do
+    b=$(basename "$f" .volt)
+    for fold in "" --no-fold; do
+        got=$OUT/$b$fold.out
+        # shellcheck disable=SC2086
+        if bin/irprint $fold "$f" > "$OUT/$b.ll" 2> "$got"; then
+            if [ -n "$OPT" ] && ! "$OPT" -passes=verify -disable-output "$OUT/$b.ll"; then
+                echo "FAIL $f $fold: opt -passes=verify"
+                fail=1
+                continue
+            fi
+            if [ -z "$LLI" ]; then continue; fi
+            "$LLI" "$OUT/$b.ll" > "$got"
+        fi
+        if ! cmp -s "tests/ir/$b.out" "$got"; then
+            echo "FAIL $f $fold"
+            diff "tests/ir/$b.out" "$got" | head -20 || true
+            fail=1
+        fi
+    done
+done
+if [ "$fail" = 0 ]; then echo "ir: ok"; fi
+exit "$fail"
@@ -0,0 +1,113 @@
+// IR with printed results, for comparing the LLVM IR path with --run.
+//
+//   irprint [--no-fold] [--no-switch] <file.volt>
+//
+// Writes the program's IR to stdout with a printf of every top-level
+// variable at the end of @main, in the format --run uses ("name = value",
+// and "name = [v0, v1, ...]" for an array).
+// The body is emitted as one chunk (see CodeGen::emitChunk), whose exports
+// are the final values of the top-level variables. Run the result with lli.
+#include <iostream>
+#include <string>
+#include "codegen.h"
+#include "fold.h"
+#include "parser.h"
+#include "sema.h"
+#include "source.h"
+
+namespace {
+
+// printf format of a value, as formatReg prints it for int, float and
+// double.
+const char* format(VoltType t) {
+    switch (t) {
+    case VoltType::FLOAT: return "%.9g";
+    case VoltType::DOUBLE: return "%.17g";
+    case VoltType::U32: return "%u";
+    case VoltType::I64: return "%lld";
+    case VoltType::U64: return "%llu";
+    default: return "%d";
+    }
+}
+
+// printf argument for a value of type t: floats are passed as double and
+// i8 / i16 / u8 / u16 as i32, converted into `name` by code added to calls.
+std::string argument(VoltType t, const std::string& value, const std::string& name, std::string& calls) {
+    std::string arg = voltTypeToLLVM(t) + ' ' + value;
+    const char* conv = t == VoltType::FLOAT                        ? "fpext"
+                       : t == VoltType::I8 || t == VoltType::I16 ? "sext"
+                       : t == VoltType::U8 || t == VoltType::U16 ? "zext"
+                                                                 : nullptr;
+    if (!conv) return arg;
+    std::string to = t == VoltType::FLOAT ? "double" : "i32";
+    calls += "  " + name + " = " + conv + ' ' + arg + " to " + to + "\n";
+    return to + ' ' + name;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool fold = true;
+    CodeGenOptions options;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-fold") fold = false;
+        else if (arg == "--no-switch") options.switches = false;
+        else path = arg;
+    }
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--no-fold] [--no-switch] <file.volt>\n";
+        return 2;
+    }
+    try {
+        SourceFile source(path);
+        Ast ast = Parser::parseProgram(source.text());
+        Context ctx;
+        Sema sema(ast, ctx);
+        if (!sema.run()) {
+            for (const auto& d : sema.diagnostics()) std::cerr << path << ": " << d.message << "\n";
+            return 1;
+        }
+        if (fold) Folder(ast).run();
+        IrWriter body;
+        CodeGen gen(ast, ctx, body, options);
+        gen.emitChunk("c0", {});
+
+        std::string globals, calls;
+        int k = 0;
+        for (const CodeGen::Export& e : gen.exports()) {
+            // An array is printed as "name = [v0, v1, ...]", one extracted
+            // element per value.
+            std::string id = std::to_string(k++);
+            std::string text = std::string(ast.str(e.sym)) + " = ";
+            std::string args;
+            if (e.length == 0) {
+                text += format(e.type);
+                args = ", " + argument(e.type, e.value, "%p." + id, calls);
+            } else {
+                std::string vector = voltTypeToLLVM(e.type, e.length);
+                text += '[';
+                for (uint32_t i = 0; i < e.length; ++i) {
+                    std::string element = "%e." + id + '.' + std::to_string(i);
+                    calls += "  " + element + " = extractelement " + vector + ' ' + e.value + ", i32 " +
+                             std::to_string(i) + "\n";
+                    text += std::string(i ? ", " : "") + format(e.type);
+                    args += ", " + argument(e.type, element, "%p." + id + '.' + std::to_string(i), calls);
+                }
+                text += ']';
+            }
+            std::string array = "[" + std::to_string(text.size() + 2) + " x i8]";
+            globals += "@s." + id + " = private constant " + array + " c\"" + text + "\\0A\\00\"\n";
+            calls += "  call i32 (i8*, ...) @printf(i8* getelementptr (" + array + ", " + array + "* @s." + id +
+                     ", i32 0, i32 0)" + args + ")\n";
+        }
+        std::cout << moduleHeader() << "declare i32 @printf(i8*, ...)\n"
+                  << globals << "define i32 @main() {\nc0:\n"
+                  << body.takeText() << calls << "  ret i32 0\n}\n";
+    } catch (const std::exception& e) {
+        std::cerr << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
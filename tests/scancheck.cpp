@@ -0,0 +1,81 @@
+// Cross-check of the lexer's vector scanners against the scalar reference.
+//
+//   scancheck [--seed N] [--buffers N]
+//
+// Generates random buffers made of runs of space, identifier, digit, ';'
+// and other bytes (runs of up to 80 bytes, so they cross the 16- and
+// 32-byte blocks at every alignment), and for every backend this build and
+// CPU have, compares skipSpace, scanIdent, scanDigits and findTerminator
+// with scalar:: at every offset of every buffer. Prints the first mismatch
+// and exits 1, or prints a summary and exits 0.
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "scan.h"
+
+namespace {
+
+std::string randomBuffer(std::mt19937& rng) {
+    static const std::string classes[] = {
+        " \t\n\v\f\r",
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789",
+        "0123456789",
+        ";",
+        "+-*/()[]<>=!.,:&|#\"'\x7f\x80\xc3\xff",
+    };
+    size_t size = rng() % 300;
+    std::string text;
+    while (text.size() < size) {
+        const std::string& c = classes[rng() % 5];
+        size_t run = 1 + rng() % 80;
+        for (size_t i = 0; i < run && text.size() < size; ++i) {
+            // Now and then a byte from anywhere, including \0 and high bytes.
+            if (rng() % 16 == 0) text += static_cast<char>(rng() % 256);
+            else text += c[rng() % c.size()];
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned seed = 1, buffers = 20000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--seed") seed = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--buffers") buffers = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+    }
+    struct Check {
+        const char* name;
+        size_t (*fast)(std::string_view, size_t);
+        size_t (*ref)(std::string_view, size_t);
+    };
+    const Check checks[] = {
+        {"skipSpace", skipSpace, scalar::skipSpace},
+        {"scanIdent", scanIdent, scalar::scanIdent},
+        {"scanDigits", scanDigits, scalar::scanDigits},
+        {"findTerminator", findTerminator, scalar::findTerminator},
+    };
+    std::string tested;
+    for (const char* backend : {"scalar", "sse2", "avx2"}) {
+        if (!setScanBackend(backend)) continue;
+        std::mt19937 rng(seed);
+        for (unsigned b = 0; b < buffers; ++b) {
+            std::string text = randomBuffer(rng);
+            for (size_t pos = 0; pos <= text.size(); ++pos) {
+                for (const Check& c : checks) {
+                    size_t got = c.fast(text, pos), want = c.ref(text, pos);
+                    if (got == want) continue;
+                    std::printf("FAIL %s %s: buffer %u (seed %u, %zu bytes), offset %zu: %zu, expected %zu\n", backend,
+                                c.name, b, seed, text.size(), pos, got, want);
+                    return 1;
+                }
+            }
+        }
+        tested += tested.empty() ? backend : std::string(", ") + backend;
+    }
+    std::printf("scancheck: ok (%s; %u buffers)\n", tested.c_str(), buffers);
+    return 0;
+}
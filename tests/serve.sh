@@ -0,0 +1,115 @@
+#!/bin/sh
+# Starts a compile server and sends it requests with --connect: compile
+# and run for each example, a program with a syntax error, the same file
+# again after it is edited, stats and shutdown. Compiled IR must match a
+# --cache compile and run output must match --run. The server must exit
+# with status 0 after shutdown and remove its socket.
+#
+#   tests/serve.sh
+set -e
+
+OUT=tests/out/serve
+rm -rf "$OUT"
+mkdir -p "$OUT/src"
+
+if [ "$(uname -s)" != Linux ]; then
+    echo "serve: skipped, the server needs Linux"
+    exit 0
+fi
+
+SOCK=$OUT/sock
+bin/voltage --serve "$SOCK" 2> "$OUT/server.err" &
+pid=$!
+trap 'kill "$pid" 2> /dev/null || true' EXIT
+i=0
+while [ ! -S "$SOCK" ]; do
+    i=$((i + 1))
+    if [ "$i" -gt 100 ] || ! kill -0 "$pid" 2> /dev/null; then
+        echo "FAIL server did not start"
+        cat "$OUT/server.err"
+        exit 1
+    fi
+    sleep 0.05
+done
+
+fail=0
+# same <what> <want> <got>: compares two outputs.
+same() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL $1"
+        diff "$2" "$3" | head -20 || true
+        fail=1
+    fi
+}
+
+# request <out> <request...>: sends one request, which must succeed.
+request() {
+    o=$1
+    shift
+    if ! bin/voltage --connect "$SOCK" "$@" > "$o" 2> "$o.err"; then
+        echo "FAIL $*"
+        cat "$o.err"
+        fail=1
+    fi
+}
+
+cp examples/*.volt "$OUT/src"
+n=$(ls "$OUT"/src/*.volt | wc -l)
+for f in "$OUT"/src/*.volt; do
+    b=$OUT/$(basename "$f" .volt)
+    bin/voltage --run "$f" > "$b.run"
+    for fold in "" --no-fold; do
+        rm -rf "$OUT/cache"
+        # shellcheck disable=SC2086
+        bin/voltage --cache "$OUT/cache" $fold "$f" -o "$b$fold.ll"
+        # shellcheck disable=SC2086
+        request "$b$fold.served.ll" compile $fold "$f"
+        same "compile $fold $f" "$b$fold.ll" "$b$fold.served.ll"
+        # shellcheck disable=SC2086
+        request "$b$fold.served.run" run $fold "$f"
+        same "run $fold $f" "$b.run" "$b$fold.served.run"
+    done
+done
+
+# Errors come back as an error reply.
+printf 'what x: int = ;\n' > "$OUT/src/bad.volt"
+if bin/voltage --connect "$SOCK" compile "$OUT/src/bad.volt" > /dev/null 2> "$OUT/bad.err" ||
+    ! grep -q "Expected number" "$OUT/bad.err"; then
+    echo "FAIL compile of a syntax error"
+    cat "$OUT/bad.err"
+    fail=1
+fi
+
+# An edited file is compiled again, not answered from memory.
+f=$OUT/src/main.volt
+printf 'what edited: int = 42;\n' >> "$f"
+rm -rf "$OUT/cache"
+bin/voltage --cache "$OUT/cache" "$f" -o "$OUT/edited.ll"
+request "$OUT/edited.served.ll" compile "$f"
+same "compile after an edit" "$OUT/edited.ll" "$OUT/edited.served.ll"
+request "$OUT/edited.served.run" run "$f"
+if ! grep -qx "edited = 42" "$OUT/edited.served.run"; then
+    echo "FAIL run after an edit"
+    fail=1
+fi
+
+request "$OUT/stats" stats
+# Two per example, plus the syntax error and the edited file.
+if ! grep -q "^compile: $((2 * n + 2)) requests" "$OUT/stats" ||
+    ! grep -q "^run: $((2 * n + 1)) requests" "$OUT/stats"; then
+    echo "FAIL stats"
+    cat "$OUT/stats"
+    fail=1
+fi
+
+request "$OUT/shutdown" shutdown
+status=0
+wait "$pid" || status=$?
+trap - EXIT
+if [ "$status" != 0 ] || [ -e "$SOCK" ]; then
+    echo "FAIL shutdown: status $status"
+    cat "$OUT/server.err"
+    fail=1
+fi
+if [ "$fail" = 0 ]; then echo "serve: ok"; fi
+exit "$fail"
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Writes every program in examples/ and tests/ir/ as a .voltc module, with
+# and without constant folding, and loads it again. The module must print
+# the same values as the source with --run (and --jit on x86-64 hosts) and
+# compile to the same IR. A folded module given --no-fold, a truncated
+# module and a file that is not a module must be rejected.
+#
+#   tests/voltc.sh
+set -e
+
+OUT=tests/out/voltc
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+JIT=
+if [ "$(uname -m)" = x86_64 ]; then JIT=1; fi
+
+fail=0
+# same <what> <want> <got>: compares two outputs.
+same() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL $1"
+        diff "$2" "$3" | head -20 || true
+        fail=1
+    fi
+}
+
+# rejected <what> <file> [options]: the module must not load.
+rejected() {
+    what=$1
+    shift
+    if bin/voltage "$@" -o "$OUT/rejected.ll" 2> "$OUT/rejected.err"; then
+        echo "FAIL $what: loaded"
+        fail=1
+    fi
+}
+
+for f in examples/*.volt tests/ir/[!e]*.volt; do
+    b=$(basename "$f" .volt)
+    for fold in "" --no-fold; do
+        o=$OUT/$b$fold
+        # shellcheck disable=SC2086
+        if ! bin/voltage --emit-voltc $fold "$f" -o "$o.voltc"; then
+            echo "FAIL $f $fold: --emit-voltc"
+            fail=1
+            continue
+        fi
+        # shellcheck disable=SC2086
+        bin/voltage $fold "$f" -o "$o.ll"
+        # shellcheck disable=SC2086
+        bin/voltage $fold "$o.voltc" -o "$o.voltc.ll"
+        same "$f $fold IR" "$o.ll" "$o.voltc.ll"
+        # Arrays and sized types only compile to IR.
+        case $f in examples/*) ;; *) continue ;; esac
+        # shellcheck disable=SC2086
+        bin/voltage --run $fold "$f" > "$o.run"
+        # shellcheck disable=SC2086
+        bin/voltage --run $fold "$o.voltc" > "$o.voltc.run" || true
+        same "$f $fold --run" "$o.run" "$o.voltc.run"
+        if [ -n "$JIT" ]; then
+            # shellcheck disable=SC2086
+            bin/voltage --jit $fold "$o.voltc" > "$o.voltc.jit" || true
+            same "$f $fold --jit" "$o.run" "$o.voltc.jit"
+        fi
+    done
+done
+
+m=$OUT/main.voltc
+rejected "folded module with --no-fold" --no-fold "$m"
+head -c 100 "$m" > "$OUT/header.voltc"
+rejected "module cut inside its header" "$OUT/header.voltc"
+head -c "$(($(wc -c < "$m") - 8))" "$m" > "$OUT/truncated.voltc"
+rejected "truncated module" "$OUT/truncated.voltc"
+printf 'what x: int = 1;\n' > "$OUT/text.voltc"
+rejected "source text named .voltc" "$OUT/text.voltc"
+if [ "$fail" = 0 ]; then echo "voltc: ok"; fi
+exit "$fail"